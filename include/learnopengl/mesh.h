@@ -7,25 +7,28 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/GeometryPool.h>
+#include <rg/Vertex.h>
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
+// how a material covers what is behind it, classified from the MTL's d and map_d when the model loads
+enum MaterialAlpha {
+    MATERIAL_OPAQUE,
+    // cut-outs: drawn with the opaque geometry, fragments below ALPHA_CUTOFF are discarded
+    MATERIAL_ALPHA_TESTED,
+    // drawn back-to-front after the opaque geometry, the only draws with blending on
+    MATERIAL_TRANSLUCENT
 };
 
-
+const float ALPHA_CUTOFF = 0.5f;
 
 struct Texture {
     unsigned int id;
@@ -40,21 +43,56 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
+    // both vertex arrays belong to the shared GeometryPool, every mesh has the same two
     unsigned int VAO;
+    // positions only, same index buffer; used by the depth pre-pass to fetch 12 bytes per vertex instead of 56
+    unsigned int depthVAO;
+    // where the mesh's indices and vertices start in the pool
+    unsigned int firstIndex;
+    int baseVertex;
+    // the mesh's part of the pool, given back when the mesh is destroyed; makes meshes move-only
+    GeometryRange geometry;
     std::string glslIdentifierPrefix;
+    // object space bounds, used for culling
+    BoundingBox bounds;
+    BoundingSphere boundingSphere;
+    // opacity multiplies the diffuse texture's alpha
+    MaterialAlpha alphaMode;
+    float opacity;
+    // meshes with the same textures and alpha share an id, the render queue sorts by it to skip rebinding
+    unsigned int textureSetId;
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         MaterialAlpha alphaMode = MATERIAL_OPAQUE, float opacity = 1.0f)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->alphaMode = alphaMode;
+        this->opacity = opacity;
 
+        computeBounds();
+        textureSetId = internTextureSet(textures, alphaMode, opacity);
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
     // render the mesh
     void Draw(Shader &shader)
+    {
+        BindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        DrawElements();
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // bind the textures to consecutive units and point the shader's samplers at them, along with the alpha uniforms
+    void BindTextures(Shader &shader) const
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -81,59 +119,76 @@ public:
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+        glUniform1f(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + "opacity").c_str()), opacity);
+        glUniform1f(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + "alphaCutoff").c_str()),
+                    alphaMode == MATERIAL_ALPHA_TESTED ? ALPHA_CUTOFF : 0.0f);
+    }
 
+    // issue the draw call, expects VAO or depthVAO to be bound
+    void DrawElements() const
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT,
+                                 (void*) (firstIndex * sizeof(unsigned int)), baseVertex);
+    }
 
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // forgets every texture set, the next mesh starts again at id 0. Call only while no mesh is alive, like
+    // between unloading a scene and loading the next, so the table doesn't grow with the texture names of
+    // every scene ever loaded and the ids stay within the bits the render queue's sort key keeps
+    static void ReleaseTextureSets()
+    {
+        textureSets().clear();
     }
 
 private:
-    // render data
-    unsigned int VBO, EBO;
+    static std::map<vector<unsigned int>, unsigned int>& textureSets()
+    {
+        static std::map<vector<unsigned int>, unsigned int> ids;
+        return ids;
+    }
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    static unsigned int internTextureSet(const vector<Texture> &textures, MaterialAlpha alphaMode, float opacity)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        std::map<vector<unsigned int>, unsigned int>& ids = textureSets();
+        vector<unsigned int> key;
+        for (const Texture& texture : textures)
+            key.push_back(texture.id);
+        unsigned int opacityBits;
+        std::memcpy(&opacityBits, &opacity, sizeof(opacityBits));
+        key.push_back(alphaMode);
+        key.push_back(opacityBits);
+        auto it = ids.find(key);
+        if (it != ids.end())
+            return it->second;
+        unsigned int id = ids.size();
+        ids[key] = id;
+        return id;
+    }
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    // box around all vertices and a sphere centered in the box that encloses them
+    void computeBounds()
+    {
+        for (const Vertex& vertex : vertices)
+            bounds.expand(vertex.Position);
+        if (bounds.empty())
+            return;
+        boundingSphere.center = bounds.center();
+        float radiusSquared = 0.0f;
+        for (const Vertex& vertex : vertices) {
+            glm::vec3 d = vertex.Position - boundingSphere.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+        }
+        boundingSphere.radius = std::sqrt(radiusSquared);
+    }
 
-        glBindVertexArray(0);
+    // copies the vertices and indices into the shared buffers
+    void setupMesh()
+    {
+        GeometryPool& pool = GeometryPool::shared();
+        geometry = pool.add(vertices, indices);
+        firstIndex = (unsigned int) geometry.firstIndex();
+        baseVertex = (int) geometry.firstVertex();
+        VAO = pool.vertexArray();
+        depthVAO = pool.depthVertexArray();
     }
 };
 #endif
\ No newline at end of file
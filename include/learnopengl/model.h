@@ -12,6 +12,13 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <rg/Frustum.h>
+#include <rg/OcclusionCuller.h>
+#include <rg/SoftwareOcclusion.h>
+#include <rg/RenderQueue.h>
+#include <rg/CpuProfiler.h>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
 
 #include <string>
 #include <fstream>
@@ -30,32 +37,102 @@ class Model
 public:
     // model data
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<GLTexture> ownedTextures;	// deletes the textures of textures_loaded with the model
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // union of the mesh bounds, lets a whole model be rejected with a single test
+    BoundingBox bounds;
+    BoundingSphere boundingSphere;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
     {
         loadModel(path);
+        computeBounds();
     }
 
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
+        RG_PROFILE_SCOPE("Model::Draw");
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
 
+    // queues the meshes the culler considers visible with the given model matrix,
+    // skipping or conditioning them on last frame's occlusion query when an occlusion culler is given.
+    // Translucent meshes go to the transparent pass, drawn with translucentShader when shader can't blend (the g-buffer)
+    void Submit(RenderQueue &queue, Shader &shader, const glm::mat4 &modelMatrix, ViewCuller &culler,
+                RenderPass pass = RENDER_PASS_OPAQUE, OcclusionCuller *occlusion = nullptr,
+                Shader *translucentShader = nullptr)
+    {
+        RG_PROFILE_SCOPE("Model::Submit");
+        if (!culler.isVisible(bounds, boundingSphere, modelMatrix)) {
+            culler.culledMeshes += meshes.size();
+            return;
+        }
+        const SoftwareOcclusion *softwareOcclusion = culler.softwareOcclusion;
+        if (softwareOcclusion && !softwareOcclusion->isVisible(bounds.transformed(modelMatrix))) {
+            culler.occludedMeshes += meshes.size();
+            return;
+        }
+        unsigned int occlusionQuery = 0;
+        if (occlusion) {
+            bool occluded;
+            occlusionQuery = occlusion->test(this, bounds.transformed(modelMatrix), occluded);
+            if (occluded) {
+                occlusion->culledDraws += meshes.size();
+                return;
+            }
+        }
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            const Mesh& mesh = meshes[i];
+            // a single mesh was already tested with the model
+            if (meshes.size() > 1 && !culler.isVisible(mesh.bounds, mesh.boundingSphere, modelMatrix)) {
+                culler.culledMeshes++;
+                continue;
+            }
+            if (meshes.size() > 1 && softwareOcclusion
+                && !softwareOcclusion->isVisible(mesh.bounds.transformed(modelMatrix))) {
+                culler.occludedMeshes++;
+                continue;
+            }
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(mesh.boundingSphere.center, 1.0f));
+            if (mesh.alphaMode == MATERIAL_TRANSLUCENT)
+                queue.submit(RENDER_PASS_TRANSPARENT, translucentShader ? *translucentShader : shader, mesh,
+                             modelMatrix, center, occlusionQuery);
+            else
+                queue.submit(pass, shader, mesh, modelMatrix, center, occlusionQuery);
+            culler.visibleMeshes++;
+            if (occlusionQuery)
+                occlusion->conditionalDraws++;
+        }
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
         }
     }
 private:
+    void computeBounds()
+    {
+        for (const Mesh& mesh : meshes)
+            bounds.expand(mesh.bounds);
+        if (bounds.empty())
+            return;
+        boundingSphere.center = bounds.center();
+        for (const Mesh& mesh : meshes) {
+            float reach = glm::length(mesh.boundingSphere.center - boundingSphere.center) + mesh.boundingSphere.radius;
+            boundingSphere.radius = std::max(boundingSphere.radius, reach);
+        }
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        RG_PROFILE_SCOPE("Model::loadModel");
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -161,6 +238,9 @@ private:
         // normal: texture_normalN
         aiColor3D color(0.0f, 0.0f, 0.0f);
         material->Get(AI_MATKEY_COLOR_AMBIENT, color);
+        float opacity = 1.0f;
+        material->Get(AI_MATKEY_OPACITY, opacity);
+        MaterialAlpha alphaMode = classifyAlpha(material, opacity);
 
 
         // 1. diffuse maps
@@ -179,7 +259,25 @@ private:
 
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(vertices, indices, textures, alphaMode, opacity);
+    }
+
+    // d below 1 blends. A map_d alone is ambiguous: exporters write it for glass as well as for cut-outs, so it
+    // blends too unless the illumination model is known and isn't one of MTL's transparent ones (4, 6, 7, 9).
+    // The alpha itself is read from the diffuse texture, which is where Blender's map_d points
+    static MaterialAlpha classifyAlpha(aiMaterial *material, float opacity)
+    {
+        if (opacity < 1.0f)
+            return MATERIAL_TRANSLUCENT;
+        if (material->GetTextureCount(aiTextureType_OPACITY) == 0)
+            return MATERIAL_OPAQUE;
+#ifdef AI_MATKEY_OBJ_ILLUM
+        int illum = 0;
+        if (material->Get(AI_MATKEY_OBJ_ILLUM, illum) == AI_SUCCESS
+            && illum != 4 && illum != 6 && illum != 7 && illum != 9)
+            return MATERIAL_ALPHA_TESTED;
+#endif
+        return MATERIAL_TRANSLUCENT;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -210,6 +308,7 @@ private:
                 texture.path = str.C_Str();
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                ownedTextures.push_back(GLTexture::adopt(texture.id));
             }
         }
         return textures;
@@ -219,6 +318,7 @@ private:
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
+    RG_PROFILE_FUNCTION();
     string filename = string(path);
     filename = directory + '/' + filename;
 
@@ -240,6 +340,9 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         glBindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        // owned by the model, named after its directory
+        GpuMemory::shared().track(GPU_OBJECT_TEXTURE, textureID, GpuMemory::textureBytes(format, width, height, 1, true),
+                                  GPU_MEMORY_TEXTURES, directory);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
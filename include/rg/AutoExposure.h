@@ -0,0 +1,196 @@
+#ifndef PROJECT_BASE_AUTOEXPOSURE_H
+#define PROJECT_BASE_AUTOEXPOSURE_H
+
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/ComputeShader.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
+
+// Average scene luminance for the composite's exposure, measured and adapted on the GPU.
+//
+// Each frame reduces the resolved hdr scene to one average luminance and moves the adapted
+// luminance, a 1x1 R32F texture, towards it, faster when it gets brighter than when it gets darker.
+// The composite divides its exposure by the adapted luminance, which never goes below
+// minAdaptedLuminance, so the exposure it ends up with is at most maxExposure(). Nothing is read back,
+// the CPU never waits for the result.
+//
+// On GL 3.3 the reduction is a mip chain: log2 luminance, weighted by whether the pixel is in the
+// measured range, and the weight are drawn into a LUMINANCE_SIZE square, glGenerateMipmap averages
+// both down and the top level's ratio is the log average. With compute shaders a histogram of log2
+// luminance is built with shared memory atomics instead, and its weighted average leaves out the
+// first bin. Either way the pixels darker than the range, like the black space around saturn, don't
+// count, and a scene without any measures as the bottom of the range.
+class AutoExposure {
+public:
+    static const int LUMINANCE_SIZE = 256;
+    // has to match BINS in histogram.comp and exposure.comp
+    static const unsigned int HISTOGRAM_BINS = 256;
+
+    bool enabled = true;
+    // histogram reduction when compute shaders are available
+    bool histogram = true;
+    // log2 luminance range measured, darker pixels are left out and brighter ones clamped to it
+    float minLogLuminance = -10.0f;
+    float maxLogLuminance = 4.0f;
+    // darkest average the exposure adapts to, it bounds the exposure the hdr format is checked for
+    float minAdaptedLuminance = 1.0f / 32.0f;
+    // adaptation rates per second towards a brighter and a darker scene
+    float speedUp = 3.0f;
+    float speedDown = 1.0f;
+
+    AutoExposure() {
+        m_LogLuminance = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, m_LogLuminance.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, LUMINANCE_SIZE, LUMINANCE_SIZE, 0, GL_RG, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GpuMemory& memory = GpuMemory::shared();
+        memory.track(GPU_OBJECT_TEXTURE, m_LogLuminance.id(),
+                     GpuMemory::textureBytes(GL_RG16F, LUMINANCE_SIZE, LUMINANCE_SIZE, 1, true),
+                     GPU_MEMORY_RENDER_TARGETS, "AutoExposure");
+        m_LogLuminanceFBO = GLFramebuffer::create();
+        glBindFramebuffer(GL_FRAMEBUFFER, m_LogLuminanceFBO.id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_LogLuminance.id(), 0);
+
+        const float initial = 1.0f;
+        for (unsigned int i = 0; i < 2; i++) {
+            m_Adapted[i] = GLTexture::create();
+            glBindTexture(GL_TEXTURE_2D, m_Adapted[i].id());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &initial);
+            memory.track(GPU_OBJECT_TEXTURE, m_Adapted[i].id(), GpuMemory::textureBytes(GL_R32F, 1, 1),
+                         GPU_MEMORY_RENDER_TARGETS, "AutoExposure");
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            m_AdaptedFBO[i] = GLFramebuffer::create();
+            glBindFramebuffer(GL_FRAMEBUFFER, m_AdaptedFBO[i].id());
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Adapted[i].id(), 0);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (glExtensions().computeShaders) {
+            unsigned int zeros[HISTOGRAM_BINS] = {};
+            m_Histogram = GLBuffer::create();
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Histogram.id());
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeros), zeros, GL_DYNAMIC_COPY);
+            memory.track(GPU_OBJECT_BUFFER, m_Histogram.id(), sizeof(zeros), GPU_MEMORY_OTHER, "AutoExposure");
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+    }
+
+    AutoExposure(const AutoExposure&) = delete;
+    AutoExposure& operator=(const AutoExposure&) = delete;
+
+    // mip chain reduction of scene, of which uvScale is covered. luminanceShader (luminance.fs) and
+    // adaptShader (adapt.fs) draw with drawQuad; the caller binds its own framebuffer and viewport again
+    void reduceMipChain(Shader& luminanceShader, Shader& adaptShader, void (*drawQuad)(), unsigned int scene,
+                        const glm::vec2& uvScale, float deltaTime) {
+        glDisable(GL_DEPTH_TEST);
+        glActiveTexture(GL_TEXTURE0);
+        glViewport(0, 0, LUMINANCE_SIZE, LUMINANCE_SIZE);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_LogLuminanceFBO.id());
+        luminanceShader.use();
+        luminanceShader.setVec2("uvScale", uvScale);
+        luminanceShader.setFloat("minLogLuminance", minLogLuminance);
+        luminanceShader.setFloat("maxLogLuminance", maxLogLuminance);
+        glBindTexture(GL_TEXTURE_2D, scene);
+        drawQuad();
+        glBindTexture(GL_TEXTURE_2D, m_LogLuminance.id());
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        unsigned int previous = m_Current;
+        m_Current = 1 - m_Current;
+        glViewport(0, 0, 1, 1);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_AdaptedFBO[m_Current].id());
+        adaptShader.use();
+        adaptShader.setFloat("topLevel", (float) topLevel());
+        adaptShader.setFloat("minLogLuminance", minLogLuminance);
+        setAdaptation(adaptShader, deltaTime);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_Adapted[previous].id());
+        drawQuad();
+        glActiveTexture(GL_TEXTURE0);
+        glEnable(GL_DEPTH_TEST);
+        m_Primed = true;
+    }
+
+    // histogram reduction of the sceneWidth x sceneHeight pixels at the origin of scene, with
+    // histogramCompute (histogram.comp) and exposureCompute (exposure.comp); needs compute shaders
+    void reduceHistogram(ComputeShader& histogramCompute, ComputeShader& exposureCompute, unsigned int scene,
+                         int sceneWidth, int sceneHeight, float deltaTime) {
+        const GLExtensions& extensions = glExtensions();
+        float logLuminanceRange = std::max(maxLogLuminance - minLogLuminance, 1e-3f);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_Histogram.id());
+        histogramCompute.use();
+        histogramCompute.setIVec2("sceneSize", sceneWidth, sceneHeight);
+        histogramCompute.setFloat("minLogLuminance", minLogLuminance);
+        histogramCompute.setFloat("inverseLogLuminanceRange", 1.0f / logLuminanceRange);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, scene);
+        ComputeShader::dispatch(ComputeShader::groups(sceneWidth, 16), ComputeShader::groups(sceneHeight, 16));
+        extensions.memoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        unsigned int previous = m_Current;
+        m_Current = 1 - m_Current;
+        exposureCompute.use();
+        exposureCompute.setInt("pixelCount", sceneWidth * sceneHeight);
+        exposureCompute.setFloat("minLogLuminance", minLogLuminance);
+        exposureCompute.setFloat("logLuminanceRange", logLuminanceRange);
+        setAdaptation(exposureCompute, deltaTime);
+        extensions.bindImageTexture(0, m_Adapted[m_Current].id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        extensions.bindImageTexture(1, m_Adapted[previous].id(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        ComputeShader::dispatch(1, 1);
+        // the composite samples the result, the next frame reads it as an image and the histogram cleared here
+        extensions.memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+                                 | GL_SHADER_STORAGE_BARRIER_BIT);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+        m_Primed = true;
+    }
+
+    // the largest exposure the composite uses with exposure set
+    float maxExposure(float exposure) const {
+        return enabled ? exposure / minAdaptedLuminance : exposure;
+    }
+
+    // 1x1 R32F, the adapted average luminance
+    unsigned int adaptedLuminance() const {
+        return m_Adapted[m_Current].id();
+    }
+
+    // the next reduction jumps straight to the measured luminance
+    void reset() {
+        m_Primed = false;
+    }
+
+private:
+    GLTexture m_LogLuminance;
+    GLFramebuffer m_LogLuminanceFBO;
+    GLTexture m_Adapted[2];
+    GLFramebuffer m_AdaptedFBO[2];
+    unsigned int m_Current = 0;
+    GLBuffer m_Histogram;
+    bool m_Primed = false;
+
+    static int topLevel() {
+        int level = 0;
+        for (int size = LUMINANCE_SIZE; size > 1; size /= 2)
+            ++level;
+        return level;
+    }
+
+    template<typename ShaderType>
+    void setAdaptation(const ShaderType& shader, float deltaTime) const {
+        shader.setFloat("deltaTime", deltaTime);
+        shader.setFloat("speedUp", speedUp);
+        shader.setFloat("speedDown", speedDown);
+        shader.setFloat("minAdaptedLuminance", minAdaptedLuminance);
+        shader.setBool("primed", m_Primed);
+    }
+};
+
+#endif //PROJECT_BASE_AUTOEXPOSURE_H
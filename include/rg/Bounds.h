@@ -0,0 +1,72 @@
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <cfloat>
+#include <glm/glm.hpp>
+
+struct BoundingBox {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool empty() const {
+        return min.x > max.x;
+    }
+
+    void expand(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void expand(const BoundingBox& other) {
+        if (other.empty())
+            return;
+        expand(other.min);
+        expand(other.max);
+    }
+
+    glm::vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    bool contains(const glm::vec3& point) const {
+        return point.x >= min.x && point.y >= min.y && point.z >= min.z
+               && point.x <= max.x && point.y <= max.y && point.z <= max.z;
+    }
+
+    // axis aligned box around the transformed box; the extents are projected onto the
+    // world axes through the absolute values of the matrix, so no corners need to be transformed
+    BoundingBox transformed(const glm::mat4& m) const {
+        glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extents();
+        glm::vec3 worldExtents(
+                glm::abs(m[0][0]) * e.x + glm::abs(m[1][0]) * e.y + glm::abs(m[2][0]) * e.z,
+                glm::abs(m[0][1]) * e.x + glm::abs(m[1][1]) * e.y + glm::abs(m[2][1]) * e.z,
+                glm::abs(m[0][2]) * e.x + glm::abs(m[1][2]) * e.y + glm::abs(m[2][2]) * e.z);
+        BoundingBox result;
+        result.min = c - worldExtents;
+        result.max = c + worldExtents;
+        return result;
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // the radius grows by the largest axis scale of the matrix, which keeps the sphere conservative
+    BoundingSphere transformed(const glm::mat4& m) const {
+        float sx = glm::dot(glm::vec3(m[0]), glm::vec3(m[0]));
+        float sy = glm::dot(glm::vec3(m[1]), glm::vec3(m[1]));
+        float sz = glm::dot(glm::vec3(m[2]), glm::vec3(m[2]));
+        BoundingSphere result;
+        result.center = glm::vec3(m * glm::vec4(center, 1.0f));
+        result.radius = radius * glm::sqrt(glm::max(sx, glm::max(sy, sz)));
+        return result;
+    }
+};
+
+#endif //PROJECT_BASE_BOUNDS_H
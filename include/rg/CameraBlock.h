@@ -0,0 +1,25 @@
+#ifndef PROJECT_BASE_CAMERABLOCK_H
+#define PROJECT_BASE_CAMERABLOCK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/GLExtensions.h>
+#include <rg/StreamBuffer.h>
+
+// The std140 Camera uniform block of the mesh shaders (saturn.vs, ufo.vs, depth.vs).
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+// binding point the shaders' Camera block is assigned to with Shader::setUniformBlock
+const unsigned int CAMERA_BLOCK_BINDING = 0;
+
+// writes view and projection into this frame's stream and points the Camera block at them
+inline void bindCameraBlock(StreamBuffer& stream, const glm::mat4& view, const glm::mat4& projection) {
+    CameraBlock block{view, projection};
+    StreamBuffer::Allocation allocation = stream.write(&block, sizeof(block), glExtensions().uniformBufferOffsetAlignment);
+    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, allocation.buffer, allocation.offset, sizeof(block));
+}
+
+#endif //PROJECT_BASE_CAMERABLOCK_H
@@ -0,0 +1,108 @@
+#ifndef PROJECT_BASE_COMPUTESHADER_H
+#define PROJECT_BASE_COMPUTESHADER_H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/GLExtensions.h>
+
+// A compute program, the counterpart of Shader for GL 4.3 contexts. Nothing is compiled until
+// load(), so one can be declared unconditionally and loaded only when glExtensions().computeShaders is set.
+class ComputeShader {
+public:
+    unsigned int ID = 0;
+
+    ComputeShader() = default;
+
+    ~ComputeShader() {
+        if (ID)
+            glDeleteProgram(ID);
+    }
+
+    ComputeShader(const ComputeShader&) = delete;
+    ComputeShader& operator=(const ComputeShader&) = delete;
+
+    void load(const char* path) {
+        std::string code;
+        std::ifstream file(path);
+        if (file) {
+            std::stringstream stream;
+            stream << file.rdbuf();
+            code = stream.str();
+        } else {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        }
+        const char* source = code.c_str();
+        unsigned int shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        checkErrors(shader, false);
+        ID = glCreateProgram();
+        glAttachShader(ID, shader);
+        glLinkProgram(ID);
+        checkErrors(ID, true);
+        glDeleteShader(shader);
+    }
+
+    bool loaded() const {
+        return ID != 0;
+    }
+
+    void use() const {
+        glUseProgram(ID);
+    }
+
+    void setBool(const std::string& name, bool value) const {
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
+    }
+
+    void setInt(const std::string& name, int value) const {
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    }
+
+    void setFloat(const std::string& name, float value) const {
+        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    }
+
+    void setVec2(const std::string& name, const glm::vec2& value) const {
+        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+
+    void setIVec2(const std::string& name, int x, int y) const {
+        glUniform2i(glGetUniformLocation(ID, name.c_str()), x, y);
+    }
+
+    // enough workgroups of groupSize invocations to cover size
+    static unsigned int groups(int size, int groupSize) {
+        return (unsigned int) ((size + groupSize - 1) / groupSize);
+    }
+
+    // runs the bound program
+    static void dispatch(unsigned int groupsX, unsigned int groupsY) {
+        glExtensions().dispatchCompute(groupsX, groupsY, 1);
+    }
+
+private:
+    static void checkErrors(unsigned int object, bool program) {
+        GLint success;
+        GLchar infoLog[1024];
+        if (program) {
+            glGetProgramiv(object, GL_LINK_STATUS, &success);
+            if (!success) {
+                glGetProgramInfoLog(object, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: COMPUTE\n" << infoLog << std::endl;
+            }
+        } else {
+            glGetShaderiv(object, GL_COMPILE_STATUS, &success);
+            if (!success) {
+                glGetShaderInfoLog(object, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: COMPUTE\n" << infoLog << std::endl;
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_COMPUTESHADER_H
@@ -0,0 +1,215 @@
+#ifndef PROJECT_BASE_CPUPROFILER_H
+#define PROJECT_BASE_CPUPROFILER_H
+
+// Instrumented CPU profiler writing Chrome trace JSON, which chrome://tracing and Perfetto open.
+//
+// RG_PROFILE_SCOPE(name) times the rest of the enclosing block and RG_PROFILE_FUNCTION() the
+// enclosing function; names have to be string literals or otherwise live until the trace is written.
+// RG_PROFILE_THREAD(name) names the calling thread in the trace and RG_PROFILE_WRITE_TRACE(path)
+// writes every thread's events to path, true on success.
+//
+// Every thread appends its events to its own buffer, a ring of the latest EVENT_CAPACITY events, so
+// recording takes no lock: two clock reads and a store. On x86 the clock is the time stamp counter,
+// a few cycles against tens of nanoseconds for steady_clock, converted to nanoseconds against
+// steady_clock when the trace is written. Buffers are registered once per thread
+// and outlive their thread. Writing the trace reads the buffers while threads may still record; the
+// ring slots being overwritten at that moment can come out garbled, so write between frames.
+//
+// Built without RG_PROFILER (the RG_ENABLE_PROFILER cmake option) every macro expands to nothing.
+
+#ifdef RG_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RG_PROFILER_TSC
+#elif defined(_M_X64)
+#include <intrin.h>
+#define RG_PROFILER_TSC
+#endif
+
+namespace rg {
+namespace profiler {
+
+struct Event {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+inline uint64_t steadyNs() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// event timestamps, in clock ticks
+inline uint64_t ticks() {
+#ifdef RG_PROFILER_TSC
+    return __rdtsc();
+#else
+    return steadyNs();
+#endif
+}
+
+class ThreadBuffer {
+public:
+    static const size_t EVENT_CAPACITY = 1 << 16;
+
+    const unsigned int id;
+    // set under the registry's lock
+    std::string name;
+
+    explicit ThreadBuffer(unsigned int id)
+            : id(id), name("Thread " + std::to_string(id)), m_Events(new Event[EVENT_CAPACITY]) {}
+
+    // only called by the owning thread
+    void push(const char* eventName, uint64_t start, uint64_t end) {
+        size_t written = m_Written.load(std::memory_order_relaxed);
+        m_Events[written & (EVENT_CAPACITY - 1)] = Event{eventName, start, end};
+        m_Written.store(written + 1, std::memory_order_release);
+    }
+
+    // calls visit(event) for the events still in the ring, oldest first
+    template<typename Visitor>
+    void forEach(Visitor visit) const {
+        size_t written = m_Written.load(std::memory_order_acquire);
+        size_t first = written > EVENT_CAPACITY ? written - EVENT_CAPACITY : 0;
+        for (size_t i = first; i < written; ++i)
+            visit(m_Events[i & (EVENT_CAPACITY - 1)]);
+    }
+
+private:
+    std::unique_ptr<Event[]> m_Events;
+    std::atomic<size_t> m_Written{0};
+};
+
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    ThreadBuffer* add() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Buffers.emplace_back(new ThreadBuffer((unsigned int) m_Buffers.size()));
+        return m_Buffers.back().get();
+    }
+
+    void setName(ThreadBuffer& buffer, const char* name) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        buffer.name = name;
+    }
+
+    bool writeChromeTrace(const std::string& path) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::ofstream file(path);
+        if (!file)
+            return false;
+        // timestamps count from the earliest event still recorded
+        uint64_t origin = UINT64_MAX;
+        for (const std::unique_ptr<ThreadBuffer>& buffer : m_Buffers)
+            buffer->forEach([&](const Event& event) { origin = std::min(origin, event.start); });
+        double nsPerTick = nanosecondsPerTick();
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        bool first = true;
+        for (const std::unique_ptr<ThreadBuffer>& buffer : m_Buffers) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+                 << ",\"args\":{\"name\":\"" << escaped(buffer->name.c_str()) << "\"}}";
+            first = false;
+            buffer->forEach([&](const Event& event) {
+                // microseconds with nanosecond decimals
+                file << ",\n{\"name\":\"" << escaped(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                     << ",\"ts\":" << microseconds(event.start - origin, nsPerTick)
+                     << ",\"dur\":" << microseconds(event.end - event.start, nsPerTick) << "}";
+            });
+        }
+        file << "\n]}\n";
+        return (bool) file;
+    }
+
+private:
+    std::mutex m_Mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_Buffers;
+    // both clocks at the registry's creation, to measure the tick rate against
+    const uint64_t m_CreatedNs = steadyNs();
+    const uint64_t m_CreatedTicks = ticks();
+
+    double nanosecondsPerTick() const {
+#ifdef RG_PROFILER_TSC
+        uint64_t elapsedTicks = ticks() - m_CreatedTicks;
+        uint64_t elapsedNs = steadyNs() - m_CreatedNs;
+        return elapsedTicks > 0 ? (double) elapsedNs / elapsedTicks : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+
+    static std::string microseconds(uint64_t ticks, double nsPerTick) {
+        uint64_t ns = (uint64_t) (ticks * nsPerTick);
+        std::string fraction = std::to_string(ns % 1000);
+        return std::to_string(ns / 1000) + "." + std::string(3 - fraction.size(), '0') + fraction;
+    }
+
+    static std::string escaped(const char* text) {
+        std::string result;
+        for (const char* c = text; *c; ++c) {
+            if (*c == '"' || *c == '\\')
+                result += '\\';
+            result += *c;
+        }
+        return result;
+    }
+};
+
+// the calling thread's buffer, registered on first use
+inline ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer* buffer = Registry::instance().add();
+    return *buffer;
+}
+
+class Scope {
+public:
+    explicit Scope(const char* name)
+            : m_Name(name), m_Start(ticks()) {}
+
+    ~Scope() {
+        threadBuffer().push(m_Name, m_Start, ticks());
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* m_Name;
+    uint64_t m_Start;
+};
+
+} // namespace profiler
+} // namespace rg
+
+#define RG_PROFILE_CONCAT_(a, b) a##b
+#define RG_PROFILE_CONCAT(a, b) RG_PROFILE_CONCAT_(a, b)
+#define RG_PROFILE_SCOPE(name) ::rg::profiler::Scope RG_PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define RG_PROFILE_FUNCTION() RG_PROFILE_SCOPE(__func__)
+#define RG_PROFILE_THREAD(name) ::rg::profiler::Registry::instance().setName(::rg::profiler::threadBuffer(), name)
+#define RG_PROFILE_WRITE_TRACE(path) ::rg::profiler::Registry::instance().writeChromeTrace(path)
+
+#else
+
+#define RG_PROFILE_SCOPE(name) ((void) 0)
+#define RG_PROFILE_FUNCTION() ((void) 0)
+#define RG_PROFILE_THREAD(name) ((void) 0)
+#define RG_PROFILE_WRITE_TRACE(path) false
+
+#endif
+
+#endif //PROJECT_BASE_CPUPROFILER_H
@@ -0,0 +1,159 @@
+#ifndef PROJECT_BASE_FRAMEPACER_H
+#define PROJECT_BASE_FRAMEPACER_H
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <glad/glad.h>
+#include <rg/GLObject.h>
+
+// Bounds how far the CPU runs ahead of the GPU and optionally caps the frame rate.
+//
+// endFrame(), right after the swap, puts a fence behind the frame. beginFrame() waits on the
+// oldest fences until fewer than framesInFlight frames are still queued, so with 1 the CPU starts
+// a frame only once the GPU finished the last one (lowest latency), with 3 it may record while
+// two frames are still pending (most overlap). The wait is reported as cpuWaitMs.
+//
+// A timestamp at the start and at the end of every frame gives the GPU's idle time between two
+// frames, gpuWaitMs: the time it was starved, waiting for the CPU to submit. Results are read
+// back a few frames late, like GpuTimer.
+//
+// The limiter sleeps to targetFps, coarse sleep first and a short spin for the last stretch,
+// since sleeps alone overshoot by a scheduler tick.
+class FramePacer {
+public:
+    static const unsigned int MAX_FRAMES_IN_FLIGHT = 3;
+
+    // 1..MAX_FRAMES_IN_FLIGHT
+    int framesInFlight = 2;
+    // 0 for no cap
+    float targetFps = 0.0f;
+    // applied by the caller with glfwSwapInterval, 0 disables vsync
+    int swapInterval = 1;
+
+    // statistics of the last frame
+    float cpuWaitMs = 0.0f;
+    float limiterMs = 0.0f;
+    // latest measured, a few frames old
+    float gpuWaitMs = 0.0f;
+
+    FramePacer() {
+        for (unsigned int i = 0; i < QUERY_RING_SIZE; ++i) {
+            m_StartQueries[i] = GLQuery::create();
+            m_EndQueries[i] = GLQuery::create();
+        }
+    }
+
+    ~FramePacer() {
+        for (GLsync fence : m_Fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+    }
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // call first thing in the frame, before input is read
+    void beginFrame() {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int allowedPending = (unsigned int) std::max(1, std::min(framesInFlight, (int) MAX_FRAMES_IN_FLIGHT)) - 1;
+        while (m_PendingFences > allowedPending) {
+            GLsync& oldest = m_Fences[m_OldestFence];
+            while (glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED)
+                ;
+            glDeleteSync(oldest);
+            oldest = nullptr;
+            m_OldestFence = (m_OldestFence + 1) % MAX_FRAMES_IN_FLIGHT;
+            --m_PendingFences;
+        }
+        auto afterFences = std::chrono::steady_clock::now();
+        cpuWaitMs = std::chrono::duration<float, std::milli>(afterFences - start).count();
+
+        limit(afterFences);
+        limiterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - afterFences).count();
+
+        collect();
+        glQueryCounter(m_StartQueries[m_CurrentQuery].id(), GL_TIMESTAMP);
+    }
+
+    // call right after the swap
+    void endFrame() {
+        glQueryCounter(m_EndQueries[m_CurrentQuery].id(), GL_TIMESTAMP);
+        m_QueryIssued[m_CurrentQuery] = true;
+        m_CurrentQuery = (m_CurrentQuery + 1) % QUERY_RING_SIZE;
+
+        // fewer fences than the ring holds are pending, beginFrame() waited for that
+        unsigned int slot = (m_OldestFence + m_PendingFences) % MAX_FRAMES_IN_FLIGHT;
+        m_Fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ++m_PendingFences;
+    }
+
+private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const unsigned int QUERY_RING_SIZE = MAX_FRAMES_IN_FLIGHT + 2;
+    static const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+    // sleeps end this early and the rest is spun
+    static const int SPIN_MICROSECONDS = 2000;
+
+    GLsync m_Fences[MAX_FRAMES_IN_FLIGHT] = {};
+    unsigned int m_OldestFence = 0;
+    unsigned int m_PendingFences = 0;
+
+    GLQuery m_StartQueries[QUERY_RING_SIZE];
+    GLQuery m_EndQueries[QUERY_RING_SIZE];
+    bool m_QueryIssued[QUERY_RING_SIZE] = {};
+    unsigned int m_CurrentQuery = 0;
+    GLuint64 m_PreviousEndNs = 0;
+
+    TimePoint m_Deadline;
+    bool m_HasDeadline = false;
+
+    void limit(TimePoint now) {
+        if (targetFps <= 0.0f) {
+            m_HasDeadline = false;
+            return;
+        }
+        std::chrono::duration<double> period(1.0 / targetFps);
+        if (!m_HasDeadline) {
+            m_Deadline = now;
+            m_HasDeadline = true;
+        }
+        m_Deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+        // a frame that overran the period starts the schedule over instead of rushing to catch up
+        if (m_Deadline < now) {
+            m_Deadline = now;
+            return;
+        }
+        auto sleepUntil = m_Deadline - std::chrono::microseconds((int) SPIN_MICROSECONDS);
+        if (sleepUntil > now)
+            std::this_thread::sleep_until(sleepUntil);
+        while (std::chrono::steady_clock::now() < m_Deadline)
+            std::this_thread::yield();
+    }
+
+    // reads every finished frame, oldest first; the slot about to be reused is the oldest one
+    void collect() {
+        for (unsigned int n = 0; n < QUERY_RING_SIZE; ++n) {
+            unsigned int i = (m_CurrentQuery + n) % QUERY_RING_SIZE;
+            if (!m_QueryIssued[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(m_EndQueries[i].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 startNs = 0, endNs = 0;
+            glGetQueryObjectui64v(m_StartQueries[i].id(), GL_QUERY_RESULT, &startNs);
+            glGetQueryObjectui64v(m_EndQueries[i].id(), GL_QUERY_RESULT, &endNs);
+            m_QueryIssued[i] = false;
+            if (m_PreviousEndNs != 0 && startNs > m_PreviousEndNs)
+                gpuWaitMs = (startNs - m_PreviousEndNs) / 1.0e6f;
+            else if (m_PreviousEndNs != 0)
+                gpuWaitMs = 0.0f;
+            m_PreviousEndNs = endNs;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_FRAMEPACER_H
@@ -0,0 +1,99 @@
+#ifndef PROJECT_BASE_FRAMESTATS_H
+#define PROJECT_BASE_FRAMESTATS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Rolling history of the frame times for the performance overlay.
+//
+// record() stores three floats per frame in rings of HISTORY frames; the percentiles are only
+// computed when asked for, by the overlay, from a copy of the ring, so an overlay that is hidden costs
+// nothing. The renderer's own counters (draw calls, switches, memory) are read straight from
+// RenderQueue, StreamBuffer and RenderTargetPool, they are never copied here.
+class FrameStats {
+public:
+    static const int HISTORY = 240;
+
+    struct Percentiles {
+        float p50;
+        float p95;
+        float p99;
+    };
+
+    // frameMs is the time between frames, cpuMs what the cpu spent on the frame without waiting on the
+    // gpu or vsync, gpuMs the gpu time of the frame's passes
+    void record(float frameMs, float cpuMs, float gpuMs) {
+        m_FrameMs[m_Next] = frameMs;
+        m_CpuMs[m_Next] = cpuMs;
+        m_GpuMs[m_Next] = gpuMs;
+        m_Next = (m_Next + 1) % HISTORY;
+        m_Count = std::min(m_Count + 1, HISTORY);
+    }
+
+    // frame times for ImGui::PlotLines, oldest first when read from offset() on
+    const float* frameTimes() const {
+        return m_FrameMs;
+    }
+
+    int offset() const {
+        return m_Count < HISTORY ? 0 : m_Next;
+    }
+
+    int count() const {
+        return m_Count;
+    }
+
+    float latestCpuMs() const {
+        return latest(m_CpuMs);
+    }
+
+    float latestGpuMs() const {
+        return latest(m_GpuMs);
+    }
+
+    Percentiles framePercentiles() const {
+        return percentiles(m_FrameMs);
+    }
+
+    Percentiles cpuPercentiles() const {
+        return percentiles(m_CpuMs);
+    }
+
+    Percentiles gpuPercentiles() const {
+        return percentiles(m_GpuMs);
+    }
+
+private:
+    float m_FrameMs[HISTORY] = {};
+    float m_CpuMs[HISTORY] = {};
+    float m_GpuMs[HISTORY] = {};
+    int m_Next = 0;
+    int m_Count = 0;
+    // scratch of percentiles(), kept to not allocate every time the overlay draws
+    mutable std::vector<float> m_Sorted;
+
+    float latest(const float* ring) const {
+        return m_Count ? ring[(m_Next + HISTORY - 1) % HISTORY] : 0.0f;
+    }
+
+    // nearest rank; nth_element partitions instead of sorting, each rank narrows the range of the next
+    Percentiles percentiles(const float* ring) const {
+        if (m_Count == 0)
+            return Percentiles{0.0f, 0.0f, 0.0f};
+        m_Sorted.assign(ring, ring + m_Count);
+        std::vector<float>::iterator p50 = m_Sorted.begin() + rank(0.50f);
+        std::vector<float>::iterator p95 = m_Sorted.begin() + rank(0.95f);
+        std::vector<float>::iterator p99 = m_Sorted.begin() + rank(0.99f);
+        std::nth_element(m_Sorted.begin(), p50, m_Sorted.end());
+        std::nth_element(p50, p95, m_Sorted.end());
+        std::nth_element(p95, p99, m_Sorted.end());
+        return Percentiles{*p50, *p95, *p99};
+    }
+
+    std::ptrdiff_t rank(float percentile) const {
+        return std::min((std::ptrdiff_t) (percentile * m_Count), (std::ptrdiff_t) m_Count - 1);
+    }
+};
+
+#endif //PROJECT_BASE_FRAMESTATS_H
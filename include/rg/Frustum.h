@@ -0,0 +1,109 @@
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+
+class SoftwareOcclusion;
+
+// View frustum as six world space planes, extracted from the rows of projection * view.
+// Plane normals point inwards, a point is inside when dot(plane.xyz, p) + plane.w >= 0 for all planes.
+class Frustum {
+public:
+    glm::vec4 planes[6];
+
+    Frustum() = default;
+
+    explicit Frustum(const glm::mat4& viewProjection) {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        planes[0] = rows[3] + rows[0]; // left
+        planes[1] = rows[3] - rows[0]; // right
+        planes[2] = rows[3] + rows[1]; // bottom
+        planes[3] = rows[3] - rows[1]; // top
+        planes[4] = rows[3] + rows[2]; // near
+        planes[5] = rows[3] - rows[2]; // far
+        for (glm::vec4& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool intersects(const BoundingSphere& sphere) const {
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        }
+        return true;
+    }
+
+    // a box is outside when it lies completely behind one of the planes
+    bool intersects(const BoundingBox& box) const {
+        glm::vec3 center = box.center();
+        glm::vec3 extents = box.extents();
+        for (const glm::vec4& plane : planes) {
+            float radius = glm::dot(extents, glm::abs(glm::vec3(plane)));
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Decides per frame which meshes are worth drawing: everything outside the frustum and
+// everything that would cover less than minPixelSize pixels on screen is skipped.
+class ViewCuller {
+public:
+    bool enabled = true;
+    float minPixelSize = 1.0f;
+
+    // CPU occlusion buffer of this frame's large occluders, Model::Submit skips what it hides when set
+    const SoftwareOcclusion* softwareOcclusion = nullptr;
+
+    unsigned int visibleMeshes = 0;
+    unsigned int culledMeshes = 0;
+    unsigned int occludedMeshes = 0;
+
+    void setView(const glm::mat4& projection, const glm::mat4& view, int viewportHeight) {
+        m_Frustum = Frustum(projection * view);
+        // camera position of a rigid view matrix
+        glm::mat3 rotation(view);
+        m_CameraPosition = -(glm::transpose(rotation) * glm::vec3(view[3]));
+        // pixels covered by a unit length at unit distance
+        m_PixelsPerUnit = 0.5f * viewportHeight * projection[1][1];
+        visibleMeshes = 0;
+        culledMeshes = 0;
+        occludedMeshes = 0;
+    }
+
+    bool isVisible(const BoundingBox& box, const BoundingSphere& sphere, const glm::mat4& model) const {
+        if (!enabled)
+            return true;
+        // cheap sphere test first, the box is only needed when the sphere straddles a plane
+        BoundingSphere worldSphere = sphere.transformed(model);
+        if (!m_Frustum.intersects(worldSphere))
+            return false;
+
+        float distance = glm::length(worldSphere.center - m_CameraPosition);
+        if (distance > worldSphere.radius
+            && 2.0f * worldSphere.radius * m_PixelsPerUnit < minPixelSize * distance)
+            return false;
+
+        return m_Frustum.intersects(box.transformed(model));
+    }
+
+    const Frustum& frustum() const {
+        return m_Frustum;
+    }
+
+    const glm::vec3& cameraPosition() const {
+        return m_CameraPosition;
+    }
+
+private:
+    Frustum m_Frustum;
+    glm::vec3 m_CameraPosition = glm::vec3(0.0f);
+    float m_PixelsPerUnit = 1.0f;
+};
+
+#endif //PROJECT_BASE_FRUSTUM_H
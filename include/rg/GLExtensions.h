@@ -0,0 +1,130 @@
+#ifndef PROJECT_BASE_GLEXTENSIONS_H
+#define PROJECT_BASE_GLEXTENSIONS_H
+
+#include <cstring>
+#include <glad/glad.h>
+
+// glad is generated for GL 3.3 core, the few newer entry points the renderer can use are loaded
+// here by hand. The window still asks for a 3.3 core context; drivers usually hand out their newest
+// core version anyway, so every feature is checked by version or extension. A missing feature
+// leaves its flag false and the renderer keeps to its 3.3 path.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT
+#define GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT 0x919F
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_FRAMEBUFFER_BARRIER_BIT 0x00000400
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+typedef void (APIENTRYP RG_PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect,
+                                                                GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP RG_PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP RG_PFNGLTEXBUFFERRANGEPROC)(GLenum target, GLenum internalformat, GLuint buffer,
+                                                     GLintptr offset, GLsizeiptr size);
+typedef void (APIENTRYP RG_PFNGLDISPATCHCOMPUTEPROC)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+typedef void (APIENTRYP RG_PFNGLBINDIMAGETEXTUREPROC)(GLuint unit, GLuint texture, GLint level, GLboolean layered,
+                                                      GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP RG_PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+
+// one command of a glMultiDrawElementsIndirect buffer
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct GLExtensions {
+    int majorVersion = 3;
+    int minorVersion = 3;
+    GLint uniformBufferOffsetAlignment = 256;
+
+    // GL 4.3, or ARB_multi_draw_indirect together with ARB_base_instance
+    bool multiDrawIndirect = false;
+    RG_PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect = nullptr;
+
+    // GL 4.4 or ARB_buffer_storage, for persistently mapped buffers
+    bool persistentMapping = false;
+    RG_PFNGLBUFFERSTORAGEPROC bufferStorage = nullptr;
+
+    // GL 4.3 or ARB_texture_buffer_range, a buffer texture over part of a buffer
+    bool textureBufferRange = false;
+    RG_PFNGLTEXBUFFERRANGEPROC texBufferRange = nullptr;
+    GLint textureBufferOffsetAlignment = 256;
+
+    // GL 4.3, compute shaders and the image load/store they write with
+    bool computeShaders = false;
+    RG_PFNGLDISPATCHCOMPUTEPROC dispatchCompute = nullptr;
+    RG_PFNGLBINDIMAGETEXTUREPROC bindImageTexture = nullptr;
+    RG_PFNGLMEMORYBARRIERPROC memoryBarrier = nullptr;
+
+    bool atLeast(int major, int minor) const {
+        return majorVersion > major || (majorVersion == major && minorVersion >= minor);
+    }
+};
+
+inline GLExtensions& glExtensions() {
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool hasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void loadGLExtensions(GLADloadproc load) {
+    GLExtensions& extensions = glExtensions();
+    glGetIntegerv(GL_MAJOR_VERSION, &extensions.majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &extensions.minorVersion);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &extensions.uniformBufferOffsetAlignment);
+
+    if (extensions.atLeast(4, 3)
+        || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance"))) {
+        extensions.multiDrawElementsIndirect = (RG_PFNGLMULTIDRAWELEMENTSINDIRECTPROC) load("glMultiDrawElementsIndirect");
+        extensions.multiDrawIndirect = extensions.multiDrawElementsIndirect != nullptr;
+    }
+    if (extensions.atLeast(4, 4) || hasGLExtension("GL_ARB_buffer_storage")) {
+        extensions.bufferStorage = (RG_PFNGLBUFFERSTORAGEPROC) load("glBufferStorage");
+        extensions.persistentMapping = extensions.bufferStorage != nullptr;
+    }
+    if (extensions.atLeast(4, 3) || hasGLExtension("GL_ARB_texture_buffer_range")) {
+        extensions.texBufferRange = (RG_PFNGLTEXBUFFERRANGEPROC) load("glTexBufferRange");
+        extensions.textureBufferRange = extensions.texBufferRange != nullptr;
+        if (extensions.textureBufferRange)
+            glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &extensions.textureBufferOffsetAlignment);
+    }
+    // the compute shaders are #version 430, so only the core version counts
+    if (extensions.atLeast(4, 3)) {
+        extensions.dispatchCompute = (RG_PFNGLDISPATCHCOMPUTEPROC) load("glDispatchCompute");
+        extensions.bindImageTexture = (RG_PFNGLBINDIMAGETEXTUREPROC) load("glBindImageTexture");
+        extensions.memoryBarrier = (RG_PFNGLMEMORYBARRIERPROC) load("glMemoryBarrier");
+        extensions.computeShaders = extensions.dispatchCompute && extensions.bindImageTexture && extensions.memoryBarrier;
+    }
+}
+
+#endif //PROJECT_BASE_GLEXTENSIONS_H
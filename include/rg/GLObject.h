@@ -0,0 +1,246 @@
+#ifndef PROJECT_BASE_GLOBJECT_H
+#define PROJECT_BASE_GLOBJECT_H
+
+#include <deque>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+#include <rg/GpuMemory.h>
+
+// Deletes GL objects once the GPU is done with every frame that may still use them.
+//
+// A GLObject that goes away hands its name to defer(). endFrame() puts a fence behind the frame's
+// commands for the objects deferred during it and deletes the batches whose fence has passed, without
+// waiting for the others, so a name is never recycled while a frame in flight refers to it and an
+// unloaded scene's memory is freed a few frames later instead of all at once in the middle of one.
+// Textures, buffers and renderbuffers are deleted through GpuMemory, which stops counting them then.
+//
+// The queue also counts the handles alive by type; at shutdown, after everything was released,
+// reportLeaks() lists the handles still alive and the tracked memory nobody deleted. Every texture,
+// buffer, renderbuffer, vertex array, framebuffer and query is owned by a handle; programs and sync
+// objects have none and aren't checked.
+class GLDeletionQueue {
+public:
+    // handles alive, by GpuObjectType
+    unsigned int live[GPU_OBJECT_TYPE_COUNT] = {};
+    // objects deleted by the queue since start
+    unsigned int deletedObjects = 0;
+
+    static GLDeletionQueue& shared() {
+        static GLDeletionQueue queue;
+        return queue;
+    }
+
+    GLDeletionQueue(const GLDeletionQueue&) = delete;
+    GLDeletionQueue& operator=(const GLDeletionQueue&) = delete;
+
+    void defer(GpuObjectType type, unsigned int name) {
+        m_Deferred.push_back(Object{type, name});
+    }
+
+    // call once a frame, after its last command
+    void endFrame() {
+        if (!m_Deferred.empty()) {
+            m_Batches.push_back(Batch{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), std::move(m_Deferred)});
+            m_Deferred.clear();
+        }
+        // fences pass in order, the first one still pending holds up the rest
+        while (!m_Batches.empty() && glClientWaitSync(m_Batches.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+            destroy(m_Batches.front());
+            m_Batches.pop_front();
+        }
+    }
+
+    // waits for the GPU and deletes everything deferred, before the context goes away
+    void flush() {
+        glFinish();
+        for (Batch& batch : m_Batches)
+            destroy(batch);
+        m_Batches.clear();
+        for (const Object& object : m_Deferred)
+            destroy(object);
+        m_Deferred.clear();
+    }
+
+    // deferred objects not deleted yet
+    size_t pendingCount() const {
+        size_t count = m_Deferred.size();
+        for (const Batch& batch : m_Batches)
+            count += batch.objects.size();
+        return count;
+    }
+
+    unsigned int liveCount() const {
+        unsigned int count = 0;
+        for (unsigned int alive : live)
+            count += alive;
+        return count;
+    }
+
+    // the handles alive and the memory GpuMemory still tracks; true when there is neither
+    bool reportLeaks(std::ostream& out) const {
+        const GpuMemory& memory = GpuMemory::shared();
+        if (liveCount() == 0 && memory.objectCount() == 0) {
+            out << "GL objects: no leaks (programs and sync objects not checked)" << std::endl;
+            return true;
+        }
+        out << "WARNING::GL_OBJECTS: leaked at shutdown" << std::endl;
+        for (int type = 0; type < GPU_OBJECT_TYPE_COUNT; ++type) {
+            if (live[type])
+                out << "  " << live[type] << " " << GPU_OBJECT_TYPE_NAMES[type] << " still owned by a handle" << std::endl;
+        }
+        for (const GpuMemory::OwnerUsage& usage : memory.owners())
+            out << "  " << usage.owner << ": " << usage.objects << " objects, " << usage.bytes << " bytes never deleted"
+                << std::endl;
+        out << "  programs and sync objects not checked" << std::endl;
+        return false;
+    }
+
+private:
+    struct Object {
+        GpuObjectType type;
+        unsigned int name;
+    };
+
+    struct Batch {
+        GLsync fence;
+        std::vector<Object> objects;
+    };
+
+    std::vector<Object> m_Deferred;
+    std::deque<Batch> m_Batches;
+
+    GLDeletionQueue() = default;
+
+    void destroy(Batch& batch) {
+        for (const Object& object : batch.objects)
+            destroy(object);
+        glDeleteSync(batch.fence);
+    }
+
+    void destroy(const Object& object) {
+        switch (object.type) {
+            case GPU_OBJECT_TEXTURE:
+                GpuMemory::deleteTextures(1, &object.name);
+                break;
+            case GPU_OBJECT_BUFFER:
+                GpuMemory::deleteBuffers(1, &object.name);
+                break;
+            case GPU_OBJECT_RENDERBUFFER:
+                GpuMemory::deleteRenderbuffers(1, &object.name);
+                break;
+            case GPU_OBJECT_VERTEX_ARRAY:
+                glDeleteVertexArrays(1, &object.name);
+                break;
+            case GPU_OBJECT_FRAMEBUFFER:
+                glDeleteFramebuffers(1, &object.name);
+                break;
+            case GPU_OBJECT_QUERY:
+                glDeleteQueries(1, &object.name);
+                break;
+            default:
+                return;
+        }
+        ++deletedObjects;
+    }
+};
+
+// Move-only owner of a GL object's name; the object goes to the GLDeletionQueue when the handle is
+// destroyed or reset. A class holding handles can't be copied by accident into two owners of the
+// same names, it can only be moved.
+template<GpuObjectType Type>
+class GLObject {
+public:
+    GLObject() = default;
+
+    ~GLObject() {
+        reset();
+    }
+
+    GLObject(GLObject&& other) noexcept
+            : m_Name(other.m_Name) {
+        other.m_Name = 0;
+    }
+
+    GLObject& operator=(GLObject&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_Name = other.m_Name;
+            other.m_Name = 0;
+        }
+        return *this;
+    }
+
+    GLObject(const GLObject&) = delete;
+    GLObject& operator=(const GLObject&) = delete;
+
+    // a new object; textures, buffers, vertex arrays and renderbuffers only exist once first bound
+    static GLObject create() {
+        unsigned int name = 0;
+        switch (Type) {
+            case GPU_OBJECT_TEXTURE:
+                glGenTextures(1, &name);
+                break;
+            case GPU_OBJECT_BUFFER:
+                glGenBuffers(1, &name);
+                break;
+            case GPU_OBJECT_RENDERBUFFER:
+                glGenRenderbuffers(1, &name);
+                break;
+            case GPU_OBJECT_VERTEX_ARRAY:
+                glGenVertexArrays(1, &name);
+                break;
+            case GPU_OBJECT_FRAMEBUFFER:
+                glGenFramebuffers(1, &name);
+                break;
+            case GPU_OBJECT_QUERY:
+                glGenQueries(1, &name);
+                break;
+            default:
+                break;
+        }
+        return GLObject(name);
+    }
+
+    // takes over a name generated elsewhere, like the texture of TextureFromFile()
+    static GLObject adopt(unsigned int name) {
+        return GLObject(name);
+    }
+
+    unsigned int id() const {
+        return m_Name;
+    }
+
+    explicit operator bool() const {
+        return m_Name != 0;
+    }
+
+    // hands the object to the deletion queue, the handle is empty afterwards
+    void reset() {
+        if (m_Name == 0)
+            return;
+        GLDeletionQueue& queue = GLDeletionQueue::shared();
+        queue.defer(Type, m_Name);
+        --queue.live[Type];
+        m_Name = 0;
+    }
+
+private:
+    unsigned int m_Name = 0;
+
+    explicit GLObject(unsigned int name)
+            : m_Name(name) {
+        if (m_Name)
+            ++GLDeletionQueue::shared().live[Type];
+    }
+};
+
+typedef GLObject<GPU_OBJECT_TEXTURE> GLTexture;
+typedef GLObject<GPU_OBJECT_BUFFER> GLBuffer;
+typedef GLObject<GPU_OBJECT_RENDERBUFFER> GLRenderbuffer;
+typedef GLObject<GPU_OBJECT_VERTEX_ARRAY> GLVertexArray;
+typedef GLObject<GPU_OBJECT_FRAMEBUFFER> GLFramebuffer;
+typedef GLObject<GPU_OBJECT_QUERY> GLQuery;
+
+#endif //PROJECT_BASE_GLOBJECT_H
@@ -0,0 +1,365 @@
+#ifndef PROJECT_BASE_GEOMETRYPOOL_H
+#define PROJECT_BASE_GEOMETRYPOOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
+#include <rg/Vertex.h>
+
+// A mesh's vertices and indices in the GeometryPool, given back to the pool when destroyed. Move-only
+// like the GL handles, a mesh and its copy can't both give the same range back.
+class GeometryRange {
+public:
+    GeometryRange() = default;
+
+    GeometryRange(size_t firstVertex, size_t vertexCount, size_t firstIndex, size_t indexCount)
+            : m_FirstVertex(firstVertex), m_VertexCount(vertexCount), m_FirstIndex(firstIndex),
+              m_IndexCount(indexCount), m_Owned(true) {}
+
+    inline ~GeometryRange();
+
+    GeometryRange(GeometryRange&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    inline GeometryRange& operator=(GeometryRange&& other) noexcept;
+
+    GeometryRange(const GeometryRange&) = delete;
+    GeometryRange& operator=(const GeometryRange&) = delete;
+
+    size_t firstVertex() const {
+        return m_FirstVertex;
+    }
+
+    size_t vertexCount() const {
+        return m_VertexCount;
+    }
+
+    size_t firstIndex() const {
+        return m_FirstIndex;
+    }
+
+    size_t indexCount() const {
+        return m_IndexCount;
+    }
+
+private:
+    size_t m_FirstVertex = 0;
+    size_t m_VertexCount = 0;
+    size_t m_FirstIndex = 0;
+    size_t m_IndexCount = 0;
+    bool m_Owned = false;
+};
+
+// Vertex, position and index buffers shared by every mesh, so all meshes draw from the same two
+// vertex arrays and a run of them can go out as a single multi-draw. A mesh keeps its own indices
+// and finds its data through firstIndex and baseVertex.
+//
+// Ranges given back by destroyed meshes are reused first fit by the next meshes that fit into them,
+// so loading and unloading a scene again and again doesn't grow the buffers; they never shrink.
+//
+// The model matrix is a vertex attribute of both arrays (MODEL_ATTRIBUTE and the three locations
+// after it). With instanced models on it comes from the buffer given to setModelBuffer(), read from
+// the start of the buffer with the draw's base instance as the matrix index; off, the arrays are
+// disabled and the shaders read the generic value set with setModelMatrix().
+class GeometryPool {
+public:
+    static const unsigned int MODEL_ATTRIBUTE = 5;
+
+    // the pool every Mesh uploads into, its buffers live until release()
+    static GeometryPool& shared() {
+        static GeometryPool pool;
+        return pool;
+    }
+
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    // adds a mesh; it is drawn with its own indices from the range's first index, offset by its first vertex
+    GeometryRange add(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
+        if (!m_VertexArray)
+            create();
+        size_t firstVertex, firstIndex;
+        if (!takeFree(m_FreeVertices, vertices.size(), firstVertex))
+            firstVertex = m_VertexCount;
+        if (!takeFree(m_FreeIndices, indices.size(), firstIndex))
+            firstIndex = m_IndexCount;
+        size_t vertexEnd = std::max(m_VertexCount, firstVertex + vertices.size());
+        size_t indexEnd = std::max(m_IndexCount, firstIndex + indices.size());
+        reserve(vertexEnd, indexEnd);
+
+        std::vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (const Vertex& vertex : vertices)
+            positions.push_back(vertex.Position);
+        // the copy target leaves the element array binding of whatever vertex array is bound alone
+        upload(m_VertexBuffer, firstVertex * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+        upload(m_PositionBuffer, firstVertex * sizeof(glm::vec3), positions.size() * sizeof(glm::vec3), positions.data());
+        upload(m_IndexBuffer, firstIndex * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+
+        m_VertexCount = vertexEnd;
+        m_IndexCount = indexEnd;
+        return GeometryRange(firstVertex, vertices.size(), firstIndex, indices.size());
+    }
+
+    // gives a destroyed mesh's range back; draws already issued keep reading the old contents, a later
+    // upload into the range is ordered after them
+    void remove(const GeometryRange& range) {
+        if (!m_VertexArray)
+            return;
+        giveBack(m_FreeVertices, m_VertexCount, range.firstVertex(), range.vertexCount());
+        giveBack(m_FreeIndices, m_IndexCount, range.firstIndex(), range.indexCount());
+    }
+
+    // deletes the buffers and vertex arrays, at shutdown once every mesh is gone
+    void release() {
+        m_VertexArray.reset();
+        m_DepthVertexArray.reset();
+        m_VertexBuffer.reset();
+        m_PositionBuffer.reset();
+        m_IndexBuffer.reset();
+        m_ModelBuffer = 0;
+        m_VertexCount = m_IndexCount = m_VertexCapacity = m_IndexCapacity = 0;
+        m_FreeVertices.clear();
+        m_FreeIndices.clear();
+        m_InstancedModels = false;
+    }
+
+    // all vertex attributes
+    unsigned int vertexArray() const {
+        return m_VertexArray.id();
+    }
+
+    // positions only, 12 bytes per vertex for depth only rendering
+    unsigned int depthVertexArray() const {
+        return m_DepthVertexArray.id();
+    }
+
+    // end of the used part of the buffers, the ranges given back inside it included
+
+    size_t vertexCount() const {
+        return m_VertexCount;
+    }
+
+    size_t indexCount() const {
+        return m_IndexCount;
+    }
+
+    void setInstancedModels(bool instanced) {
+        if (instanced == m_InstancedModels || !m_VertexArray)
+            return;
+        m_InstancedModels = instanced;
+        for (unsigned int vertexArray : {m_VertexArray.id(), m_DepthVertexArray.id()}) {
+            glBindVertexArray(vertexArray);
+            for (unsigned int column = 0; column < 4; ++column) {
+                if (instanced)
+                    glEnableVertexAttribArray(MODEL_ATTRIBUTE + column);
+                else
+                    glDisableVertexAttribArray(MODEL_ATTRIBUTE + column);
+            }
+        }
+        glBindVertexArray(0);
+    }
+
+    // buffer the instanced model matrices are read from, one tightly packed mat4 per instance. Always
+    // respecified, a name seen before may since have been deleted and handed out again
+    void setModelBuffer(unsigned int buffer) {
+        if (!m_VertexArray)
+            return;
+        m_ModelBuffer = buffer;
+        glBindVertexArray(m_VertexArray.id());
+        setupModelAttributes();
+        glBindVertexArray(m_DepthVertexArray.id());
+        setupModelAttributes();
+        glBindVertexArray(0);
+    }
+
+    // model matrix of the following non-instanced draws, for any vertex array without the model arrays enabled
+    static void setModelMatrix(const glm::mat4& model) {
+        for (unsigned int column = 0; column < 4; ++column)
+            glVertexAttrib4fv(MODEL_ATTRIBUTE + column, &model[column][0]);
+    }
+
+private:
+    static const size_t MIN_VERTICES = 1 << 16;
+    static const size_t MIN_INDICES = 1 << 18;
+
+    GLVertexArray m_VertexArray;
+    GLVertexArray m_DepthVertexArray;
+    GLBuffer m_VertexBuffer;
+    GLBuffer m_PositionBuffer;
+    GLBuffer m_IndexBuffer;
+    // not owned, the frame's stream buffer
+    unsigned int m_ModelBuffer = 0;
+    size_t m_VertexCount = 0;
+    size_t m_IndexCount = 0;
+    size_t m_VertexCapacity = 0;
+    size_t m_IndexCapacity = 0;
+    // ranges given back, first element -> count, none touching another or the end of the used part
+    std::map<size_t, size_t> m_FreeVertices;
+    std::map<size_t, size_t> m_FreeIndices;
+    bool m_InstancedModels = false;
+
+    GeometryPool() {
+        // constructed first, the queue is destroyed after the pool's handles
+        GLDeletionQueue::shared();
+    }
+
+    void create() {
+        m_VertexArray = GLVertexArray::create();
+        m_DepthVertexArray = GLVertexArray::create();
+        m_VertexBuffer = GLBuffer::create();
+        m_PositionBuffer = GLBuffer::create();
+        m_IndexBuffer = GLBuffer::create();
+    }
+
+    // cuts count elements from the front of the first free range large enough; false if there is none
+    static bool takeFree(std::map<size_t, size_t>& free, size_t count, size_t& first) {
+        if (count == 0)
+            return false;
+        for (auto it = free.begin(); it != free.end(); ++it) {
+            if (it->second < count)
+                continue;
+            first = it->first;
+            size_t rest = it->second - count;
+            free.erase(it);
+            if (rest > 0)
+                free[first + count] = rest;
+            return true;
+        }
+        return false;
+    }
+
+    // merges a range into its free neighbours; at the end of the used part it shortens that instead
+    static void giveBack(std::map<size_t, size_t>& free, size_t& used, size_t first, size_t count) {
+        if (count == 0)
+            return;
+        auto next = free.lower_bound(first);
+        if (next != free.end() && first + count == next->first) {
+            count += next->second;
+            next = free.erase(next);
+        }
+        if (next != free.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == first) {
+                first = previous->first;
+                count += previous->second;
+                free.erase(previous);
+            }
+        }
+        if (first + count == used)
+            used = first;
+        else
+            free[first] = count;
+    }
+
+    // grows the buffers to hold at least the given counts, keeping their contents
+    void reserve(size_t vertices, size_t indices) {
+        if (vertices <= m_VertexCapacity && indices <= m_IndexCapacity)
+            return;
+        size_t vertexCapacity = std::max(vertices, std::max(m_VertexCapacity * 2, (size_t) MIN_VERTICES));
+        size_t indexCapacity = std::max(indices, std::max(m_IndexCapacity * 2, (size_t) MIN_INDICES));
+        grow(m_VertexBuffer, m_VertexCount * sizeof(Vertex), vertexCapacity * sizeof(Vertex));
+        grow(m_PositionBuffer, m_VertexCount * sizeof(glm::vec3), vertexCapacity * sizeof(glm::vec3));
+        grow(m_IndexBuffer, m_IndexCount * sizeof(unsigned int), indexCapacity * sizeof(unsigned int));
+        m_VertexCapacity = vertexCapacity;
+        m_IndexCapacity = indexCapacity;
+        // the vertex arrays captured the old buffer names
+        setupVertexArrays();
+    }
+
+    // the old buffer goes to the deletion queue
+    static void grow(GLBuffer& buffer, size_t usedBytes, size_t newBytes) {
+        GLBuffer grown = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown.id());
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+        GpuMemory::shared().track(GPU_OBJECT_BUFFER, grown.id(), newBytes, GPU_MEMORY_GEOMETRY, "GeometryPool");
+        if (usedBytes > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer.id());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+        }
+        buffer = std::move(grown);
+    }
+
+    static void upload(const GLBuffer& buffer, size_t offset, size_t bytes, const void* data) {
+        if (bytes == 0)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.id());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+    }
+
+    void setupVertexArrays() {
+        glBindVertexArray(m_VertexArray.id());
+        glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer.id());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer.id());
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        setupModelAttributes();
+
+        glBindVertexArray(m_DepthVertexArray.id());
+        glBindBuffer(GL_ARRAY_BUFFER, m_PositionBuffer.id());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer.id());
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        setupModelAttributes();
+
+        glBindVertexArray(0);
+    }
+
+    // a mat4 attribute is four vec4 columns, advanced once per instance
+    void setupModelAttributes() {
+        if (m_ModelBuffer == 0)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, m_ModelBuffer);
+        for (unsigned int column = 0; column < 4; ++column) {
+            glVertexAttribPointer(MODEL_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void*) (column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(MODEL_ATTRIBUTE + column, 1);
+            if (m_InstancedModels)
+                glEnableVertexAttribArray(MODEL_ATTRIBUTE + column);
+            else
+                glDisableVertexAttribArray(MODEL_ATTRIBUTE + column);
+        }
+    }
+};
+
+GeometryRange::~GeometryRange() {
+    if (m_Owned)
+        GeometryPool::shared().remove(*this);
+}
+
+GeometryRange& GeometryRange::operator=(GeometryRange&& other) noexcept {
+    if (this != &other) {
+        if (m_Owned)
+            GeometryPool::shared().remove(*this);
+        m_FirstVertex = other.m_FirstVertex;
+        m_VertexCount = other.m_VertexCount;
+        m_FirstIndex = other.m_FirstIndex;
+        m_IndexCount = other.m_IndexCount;
+        m_Owned = other.m_Owned;
+        other.m_Owned = false;
+    }
+    return *this;
+}
+
+#endif //PROJECT_BASE_GEOMETRYPOOL_H
@@ -0,0 +1,252 @@
+#ifndef PROJECT_BASE_GPUMEMORY_H
+#define PROJECT_BASE_GPUMEMORY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+
+enum GpuMemoryCategory {
+    // material textures and the skybox
+    GPU_MEMORY_TEXTURES = 0,
+    // render target pool, shadow maps and the exposure targets
+    GPU_MEMORY_RENDER_TARGETS = 1,
+    // the shared vertex and index buffers and the small fixed meshes
+    GPU_MEMORY_GEOMETRY = 2,
+    // the stream buffer and the light lists
+    GPU_MEMORY_STREAMING = 3,
+    // lookup tables and the compute passes' buffers
+    GPU_MEMORY_OTHER = 4,
+    GPU_MEMORY_CATEGORY_COUNT = 5
+};
+
+const char* const GPU_MEMORY_CATEGORY_NAMES[GPU_MEMORY_CATEGORY_COUNT] = {
+        "Textures", "Render targets", "Geometry", "Streaming", "Other"
+};
+
+// GL names of different object types overlap, every type is tracked separately. Only the first three
+// have storage of their own
+enum GpuObjectType {
+    GPU_OBJECT_TEXTURE = 0,
+    GPU_OBJECT_BUFFER = 1,
+    GPU_OBJECT_RENDERBUFFER = 2,
+    GPU_OBJECT_VERTEX_ARRAY = 3,
+    GPU_OBJECT_FRAMEBUFFER = 4,
+    GPU_OBJECT_QUERY = 5,
+    GPU_OBJECT_TYPE_COUNT = 6
+};
+
+const char* const GPU_OBJECT_TYPE_NAMES[GPU_OBJECT_TYPE_COUNT] = {
+        "textures", "buffers", "renderbuffers", "vertex arrays", "framebuffers", "queries"
+};
+
+// Bookkeeping of the GPU memory the process allocates, by category and by owner, a model's directory
+// or the class that made the allocation.
+//
+// Every texture, buffer and renderbuffer gets its storage recorded with track() right after it is
+// specified, and is deleted through deleteTextures(), deleteBuffers() or deleteRenderbuffers(), which
+// forget it again. The sizes are what the storage takes at the requested format; drivers pad and
+// align, so the real footprint is somewhat larger, never smaller.
+//
+// Once a frame the caller evicts what it can spare while overBudget() and then calls checkBudget(),
+// which reports each time the memory goes over budgetBytes despite the eviction.
+class GpuMemory {
+public:
+    struct OwnerUsage {
+        std::string owner;
+        GpuMemoryCategory category;
+        size_t bytes;
+        unsigned int objects;
+    };
+
+    // 0 for no budget
+    size_t budgetBytes = 0;
+    // times the budget was exceeded, since start
+    unsigned int budgetExceeded = 0;
+
+    // the bookkeeping of the process, shared by every allocation site
+    static GpuMemory& shared() {
+        static GpuMemory memory;
+        return memory;
+    }
+
+    GpuMemory(const GpuMemory&) = delete;
+    GpuMemory& operator=(const GpuMemory&) = delete;
+
+    // records bytes as the storage of an object, replacing what was recorded for it before, so
+    // respecifying the storage is tracked again the same way
+    void track(GpuObjectType type, unsigned int name, size_t bytes, GpuMemoryCategory category,
+               const std::string& owner) {
+        if (name == 0)
+            return;
+        Allocation& allocation = m_Allocations[key(type, name)];
+        m_CategoryBytes[allocation.category] -= allocation.bytes;
+        m_TotalBytes -= allocation.bytes;
+        allocation = Allocation{bytes, category, owner};
+        m_CategoryBytes[category] += bytes;
+        m_TotalBytes += bytes;
+        m_PeakBytes = std::max(m_PeakBytes, m_TotalBytes);
+    }
+
+    void untrack(GpuObjectType type, unsigned int name) {
+        auto it = m_Allocations.find(key(type, name));
+        if (it == m_Allocations.end())
+            return;
+        m_CategoryBytes[it->second.category] -= it->second.bytes;
+        m_TotalBytes -= it->second.bytes;
+        m_Allocations.erase(it);
+    }
+
+    // glDelete* that also forgets the objects' storage
+    static void deleteTextures(GLsizei count, const unsigned int* textures) {
+        for (GLsizei i = 0; i < count; ++i)
+            shared().untrack(GPU_OBJECT_TEXTURE, textures[i]);
+        glDeleteTextures(count, textures);
+    }
+
+    static void deleteBuffers(GLsizei count, const unsigned int* buffers) {
+        for (GLsizei i = 0; i < count; ++i)
+            shared().untrack(GPU_OBJECT_BUFFER, buffers[i]);
+        glDeleteBuffers(count, buffers);
+    }
+
+    static void deleteRenderbuffers(GLsizei count, const unsigned int* renderbuffers) {
+        for (GLsizei i = 0; i < count; ++i)
+            shared().untrack(GPU_OBJECT_RENDERBUFFER, renderbuffers[i]);
+        glDeleteRenderbuffers(count, renderbuffers);
+    }
+
+    size_t totalBytes() const {
+        return m_TotalBytes;
+    }
+
+    size_t peakBytes() const {
+        return m_PeakBytes;
+    }
+
+    size_t categoryBytes(GpuMemoryCategory category) const {
+        return m_CategoryBytes[category];
+    }
+
+    size_t objectCount() const {
+        return m_Allocations.size();
+    }
+
+    // the tracked memory summed per owner and category, largest first
+    std::vector<OwnerUsage> owners() const {
+        std::map<std::pair<std::string, int>, OwnerUsage> summed;
+        for (const auto& entry : m_Allocations) {
+            const Allocation& allocation = entry.second;
+            auto inserted = summed.insert({{allocation.owner, allocation.category},
+                                           OwnerUsage{allocation.owner, allocation.category, 0, 0}});
+            inserted.first->second.bytes += allocation.bytes;
+            ++inserted.first->second.objects;
+        }
+        std::vector<OwnerUsage> usages;
+        usages.reserve(summed.size());
+        for (const auto& entry : summed)
+            usages.push_back(entry.second);
+        std::sort(usages.begin(), usages.end(), [](const OwnerUsage& a, const OwnerUsage& b) {
+            return a.bytes > b.bytes;
+        });
+        return usages;
+    }
+
+    bool overBudget() const {
+        return budgetBytes > 0 && m_TotalBytes > budgetBytes;
+    }
+
+    // call once a frame, after evicting what can be spared; warns when the memory goes over the budget.
+    // Returns overBudget()
+    bool checkBudget() {
+        bool over = overBudget();
+        if (over && !m_OverBudget) {
+            ++budgetExceeded;
+            std::cout << "WARNING::GPU_MEMORY: " << megabytes(m_TotalBytes) << " MB exceeds the budget of "
+                      << megabytes(budgetBytes) << " MB" << std::endl;
+        }
+        m_OverBudget = over;
+        return over;
+    }
+
+    // one line per category and owner, for the log
+    void printSummary(std::ostream& out) const {
+        out << "GPU memory: " << megabytes(m_TotalBytes) << " MB in " << m_Allocations.size() << " objects, peak "
+            << megabytes(m_PeakBytes) << " MB" << std::endl;
+        for (int c = 0; c < GPU_MEMORY_CATEGORY_COUNT; ++c)
+            out << "  " << GPU_MEMORY_CATEGORY_NAMES[c] << ": " << megabytes(m_CategoryBytes[c]) << " MB" << std::endl;
+        for (const OwnerUsage& usage : owners())
+            out << "  " << usage.owner << " (" << GPU_MEMORY_CATEGORY_NAMES[usage.category] << "): "
+                << megabytes(usage.bytes) << " MB in " << usage.objects << " objects" << std::endl;
+    }
+
+    // size of a pixel of an internal format as the driver is likely to store it
+    static unsigned int bytesPerPixel(GLenum internalFormat) {
+        switch (internalFormat) {
+            case GL_RED:
+            case GL_R8:
+                return 1;
+            case GL_RG8:
+            case GL_R16F:
+                return 2;
+            // three 8-bit channels are padded to four
+            case GL_RGB:
+            case GL_RGB8:
+            case GL_SRGB8:
+            case GL_RGBA:
+            case GL_RGBA8:
+            case GL_SRGB8_ALPHA8:
+            case GL_RGB10_A2:
+            case GL_R11F_G11F_B10F:
+            case GL_RG16F:
+            case GL_R32F:
+            case GL_DEPTH24_STENCIL8:
+            case GL_DEPTH_COMPONENT24:
+            case GL_DEPTH_COMPONENT32F:
+                return 4;
+            // RGB16F is padded to four channels
+            case GL_RGB16F:
+            case GL_RGBA16F:
+                return 8;
+            default:
+                return 16;
+        }
+    }
+
+    // storage of a width x height x layers texture, a full mip chain adds a third
+    static size_t textureBytes(GLenum internalFormat, int width, int height, int layers = 1, bool mipmapped = false) {
+        size_t bytes = (size_t) width * height * layers * bytesPerPixel(internalFormat);
+        return mipmapped ? bytes + bytes / 3 : bytes;
+    }
+
+private:
+    struct Allocation {
+        size_t bytes = 0;
+        GpuMemoryCategory category = GPU_MEMORY_OTHER;
+        std::string owner;
+    };
+
+    std::unordered_map<uint64_t, Allocation> m_Allocations;
+    size_t m_CategoryBytes[GPU_MEMORY_CATEGORY_COUNT] = {};
+    size_t m_TotalBytes = 0;
+    size_t m_PeakBytes = 0;
+    bool m_OverBudget = false;
+
+    GpuMemory() = default;
+
+    static uint64_t key(GpuObjectType type, unsigned int name) {
+        return ((uint64_t) type << 32) | name;
+    }
+
+    static float megabytes(size_t bytes) {
+        return bytes / (1024.0f * 1024.0f);
+    }
+};
+
+#endif //PROJECT_BASE_GPUMEMORY_H
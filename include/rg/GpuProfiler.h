@@ -0,0 +1,176 @@
+#ifndef PROJECT_BASE_GPUPROFILER_H
+#define PROJECT_BASE_GPUPROFILER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <rg/GLObject.h>
+
+// GPU time of named, nested scopes of the frame, like the passes of main.cpp.
+//
+// begin() and end() put a GL_TIMESTAMP query around a scope; timestamps, unlike GL_TIME_ELAPSED,
+// can nest. Every frame has its own set of queries in a ring of FRAME_RING frames and is read back
+// when the ring comes around to it, by then long finished, so reading never stalls. A frame whose
+// queries are still pending when its slot is needed again is dropped instead of waited for.
+//
+// results() are the scopes of the latest frame read back, in the order they began.
+class GpuProfiler {
+public:
+    static const unsigned int FRAME_RING = 4;
+
+    struct ScopeResult {
+        std::string name;
+        // nesting level, 0 for a scope outside any other
+        int depth;
+        // begin relative to the frame's first scope
+        float startMs;
+        float lastMs;
+        // exponential moving average over the frames read back
+        float averageMs;
+    };
+
+    // applied at the next beginFrame()
+    bool enabled = true;
+
+    // frames not read back because their queries weren't available in time, since start
+    unsigned int droppedFrames = 0;
+
+    GpuProfiler() = default;
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // call once a frame, before the first scope
+    void beginFrame() {
+        collect();
+        m_Current = (m_Current + 1) % FRAME_RING;
+        FrameQueries& frame = m_Frames[m_Current];
+        if (!frame.scopes.empty()) {
+            // collect() stopped at this frame, its queries are about to be reused
+            ++droppedFrames;
+            frame.scopes.clear();
+        }
+        frame.usedQueries = 0;
+        m_Open.clear();
+        m_Active = enabled;
+    }
+
+    // name has to outlive the frame, a string literal
+    void begin(const char* name) {
+        if (!m_Active)
+            return;
+        FrameQueries& frame = m_Frames[m_Current];
+        ScopeQueries scope{name, (int) m_Open.size(), nextQuery(frame), 0};
+        glQueryCounter(scope.beginQuery, GL_TIMESTAMP);
+        m_Open.push_back((unsigned int) frame.scopes.size());
+        frame.scopes.push_back(scope);
+    }
+
+    void end() {
+        if (!m_Active || m_Open.empty())
+            return;
+        FrameQueries& frame = m_Frames[m_Current];
+        ScopeQueries& scope = frame.scopes[m_Open.back()];
+        m_Open.pop_back();
+        scope.endQuery = nextQuery(frame);
+        glQueryCounter(scope.endQuery, GL_TIMESTAMP);
+    }
+
+    const std::vector<ScopeResult>& results() const {
+        return m_Results;
+    }
+
+    // one line per scope of results(): name, depth, start, last and average milliseconds
+    bool exportCsv(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+        file << "scope,depth,start_ms,last_ms,average_ms\n";
+        for (const ScopeResult& result : m_Results) {
+            file << result.name << ',' << result.depth << ',' << result.startMs << ',' << result.lastMs << ','
+                 << result.averageMs << '\n';
+        }
+        return (bool) file;
+    }
+
+private:
+    static constexpr float AVERAGE_WEIGHT = 0.05f;
+
+    struct ScopeQueries {
+        const char* name;
+        int depth;
+        unsigned int beginQuery;
+        unsigned int endQuery;
+    };
+
+    struct FrameQueries {
+        std::vector<ScopeQueries> scopes;
+        // grows to the most queries a frame used, reused from frame to frame
+        std::vector<GLQuery> queries;
+        size_t usedQueries = 0;
+    };
+
+    FrameQueries m_Frames[FRAME_RING];
+    unsigned int m_Current = 0;
+    std::vector<unsigned int> m_Open;
+    bool m_Active = false;
+    std::vector<ScopeResult> m_Results;
+
+    static unsigned int nextQuery(FrameQueries& frame) {
+        if (frame.usedQueries == frame.queries.size())
+            frame.queries.push_back(GLQuery::create());
+        return frame.queries[frame.usedQueries++].id();
+    }
+
+    // reads every finished frame, oldest first; the slot after the current one is the oldest
+    void collect() {
+        for (unsigned int n = 1; n <= FRAME_RING; ++n) {
+            FrameQueries& frame = m_Frames[(m_Current + n) % FRAME_RING];
+            if (frame.scopes.empty())
+                continue;
+            // a scope left open has no end query, the frame can't be read
+            bool complete = true;
+            for (const ScopeQueries& scope : frame.scopes)
+                complete = complete && scope.endQuery != 0;
+            if (complete) {
+                // queries finish in order, the last one issued stands for the frame
+                GLint available = 0;
+                glGetQueryObjectiv(frame.queries[frame.usedQueries - 1].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+                read(frame);
+            }
+            frame.scopes.clear();
+        }
+    }
+
+    void read(const FrameQueries& frame) {
+        std::vector<ScopeResult> results;
+        results.reserve(frame.scopes.size());
+        GLuint64 frameStartNs = 0;
+        for (const ScopeQueries& scope : frame.scopes) {
+            GLuint64 beginNs = 0, endNs = 0;
+            glGetQueryObjectui64v(scope.beginQuery, GL_QUERY_RESULT, &beginNs);
+            glGetQueryObjectui64v(scope.endQuery, GL_QUERY_RESULT, &endNs);
+            if (results.empty())
+                frameStartNs = beginNs;
+            float lastMs = endNs > beginNs ? (endNs - beginNs) / 1.0e6f : 0.0f;
+            float startMs = beginNs > frameStartNs ? (beginNs - frameStartNs) / 1.0e6f : 0.0f;
+            const ScopeResult* previous = find(scope.name, scope.depth);
+            float averageMs = previous ? previous->averageMs + (lastMs - previous->averageMs) * AVERAGE_WEIGHT : lastMs;
+            results.push_back(ScopeResult{scope.name, scope.depth, startMs, lastMs, averageMs});
+        }
+        m_Results.swap(results);
+    }
+
+    const ScopeResult* find(const char* name, int depth) const {
+        for (const ScopeResult& result : m_Results) {
+            if (result.depth == depth && result.name == name)
+                return &result;
+        }
+        return nullptr;
+    }
+};
+
+#endif //PROJECT_BASE_GPUPROFILER_H
@@ -0,0 +1,73 @@
+#ifndef PROJECT_BASE_GPUTIMER_H
+#define PROJECT_BASE_GPUTIMER_H
+
+#include <glad/glad.h>
+#include <rg/GLObject.h>
+
+// Measures GPU time of a span of commands with a pair of GL_TIMESTAMP queries.
+// Unlike GL_TIME_ELAPSED, timestamps can be taken inside a span measured by another timer.
+// Queries live in a small ring so a result is read back a few frames later, when it is
+// already available, instead of stalling the CPU until the GPU catches up.
+class GpuTimer {
+public:
+    static const unsigned int RING_SIZE = 4;
+
+    GpuTimer() {
+        for (unsigned int i = 0; i < RING_SIZE; ++i) {
+            m_Begin[i] = GLQuery::create();
+            m_End[i] = GLQuery::create();
+        }
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin() {
+        glQueryCounter(m_Begin[m_Current].id(), GL_TIMESTAMP);
+    }
+
+    void end() {
+        glQueryCounter(m_End[m_Current].id(), GL_TIMESTAMP);
+        m_Issued[m_Current] = true;
+        m_Current = (m_Current + 1) % RING_SIZE;
+        collect();
+    }
+
+    // last available measurement in milliseconds
+    float milliseconds() const {
+        return m_LastMs;
+    }
+
+    bool hasResult() const {
+        return m_HasResult;
+    }
+
+private:
+    GLQuery m_Begin[RING_SIZE];
+    GLQuery m_End[RING_SIZE];
+    bool m_Issued[RING_SIZE] = {};
+    unsigned int m_Current = 0;
+    float m_LastMs = 0.0f;
+    bool m_HasResult = false;
+
+    // read every finished query, oldest first; the slot about to be reused is the oldest one
+    void collect() {
+        for (unsigned int n = 0; n < RING_SIZE; ++n) {
+            unsigned int i = (m_Current + n) % RING_SIZE;
+            if (!m_Issued[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(m_End[i].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 beginNs = 0, endNs = 0;
+            glGetQueryObjectui64v(m_Begin[i].id(), GL_QUERY_RESULT, &beginNs);
+            glGetQueryObjectui64v(m_End[i].id(), GL_QUERY_RESULT, &endNs);
+            m_Issued[i] = false;
+            m_LastMs = (endNs - beginNs) / 1.0e6f;
+            m_HasResult = true;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_GPUTIMER_H
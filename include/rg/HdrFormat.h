@@ -0,0 +1,73 @@
+#ifndef PROJECT_BASE_HDRFORMAT_H
+#define PROJECT_BASE_HDRFORMAT_H
+
+#include <algorithm>
+#include <cmath>
+#include <glad/glad.h>
+
+// Formats for the color-only hdr targets: the scene color and the bloom bright pass and
+// blur buffers. None of them keeps alpha, so the packed R11G11B10F is enough and takes half
+// the memory and bandwidth of RGBA16F. Its floats have 6 (red, green) and 5 (blue) mantissa bits
+// against 10, so every format is checked for banding before it's used: the largest step between
+// two neighbouring channel values, after the composite's tonemap and gamma, must stay within
+// BANDING_LIMIT steps of the 8-bit output, which the composite's dither hides.
+struct HdrFormat {
+    GLenum internalFormat;
+    const char* name;
+    unsigned int mantissaBits[3];
+    unsigned int bytesPerPixel;
+};
+
+const HdrFormat HDR_FORMATS[] = {
+        {GL_R11F_G11F_B10F, "R11G11B10F", {6, 6, 5}, 4},
+        {GL_RGBA16F, "RGBA16F", {10, 10, 10}, 8},
+};
+const unsigned int HDR_FORMAT_COUNT = sizeof(HDR_FORMATS) / sizeof(HDR_FORMATS[0]);
+
+// in 8-bit output steps
+const float BANDING_LIMIT = 2.0f;
+
+// the composite's tone curve, ungraded, as baked into ToneMapLut: exponential tonemap, then gamma 2.2,
+// scaled to 8 bits
+inline float tonemappedOutput(float value, float exposure) {
+    return 255.0f * std::pow(1.0f - std::exp(-value * exposure), 1.0f / 2.2f);
+}
+
+// largest output step between neighbouring values of a small float with mantissaBits bits and a 5 bit
+// exponent (the 11, 10 and 16 bit GL floats), denormals included, ignoring values that already saturate
+inline float worstOutputStep(unsigned int mantissaBits, float exposure) {
+    const int exponentBias = 15;
+    const unsigned int mantissaCount = 1u << mantissaBits;
+    float worst = 0.0f;
+    float previous = tonemappedOutput(0.0f, exposure);
+    for (int exponent = 0; exponent < 31; ++exponent) {
+        for (unsigned int mantissa = exponent == 0 ? 1 : 0; mantissa < mantissaCount; ++mantissa) {
+            float fraction = (float) mantissa / mantissaCount;
+            float value = exponent == 0 ? std::ldexp(fraction, 1 - exponentBias)
+                                        : std::ldexp(1.0f + fraction, exponent - exponentBias);
+            float output = tonemappedOutput(value, exposure);
+            if (previous >= 254.5f)
+                return worst;
+            worst = std::max(worst, output - previous);
+            previous = output;
+        }
+    }
+    return worst;
+}
+
+inline const HdrFormat& hdrFormat(GLenum internalFormat) {
+    for (const HdrFormat& format : HDR_FORMATS) {
+        if (format.internalFormat == internalFormat)
+            return format;
+    }
+    return HDR_FORMATS[HDR_FORMAT_COUNT - 1];
+}
+
+// worst output step over the format's channels
+inline float worstBandingStep(GLenum internalFormat, float exposure) {
+    const HdrFormat& format = hdrFormat(internalFormat);
+    unsigned int fewestBits = std::min(format.mantissaBits[0], std::min(format.mantissaBits[1], format.mantissaBits[2]));
+    return worstOutputStep(fewestBits, exposure);
+}
+
+#endif //PROJECT_BASE_HDRFORMAT_H
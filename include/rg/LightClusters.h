@@ -0,0 +1,310 @@
+#ifndef PROJECT_BASE_LIGHTCLUSTERS_H
+#define PROJECT_BASE_LIGHTCLUSTERS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/CpuProfiler.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
+#include <rg/Lights.h>
+#include <rg/StreamBuffer.h>
+#include <rg/WorkerPool.h>
+
+// Clustered light culling. The view frustum is cut into TILES_X x TILES_Y screen tiles and SLICES
+// depth slices spaced exponentially between the near and far plane. Every point light is binned on
+// the CPU into the clusters its sphere of influence touches, one depth slice per job on the worker pool.
+// The lit shaders find their cluster from gl_FragCoord and depth and loop only over its lights,
+// so the cost per pixel follows the lights that actually reach it, not the number of lights in the scene.
+//
+// Everything goes to the GPU through buffer textures:
+//   lightData    RGBA32F, 4 texels per light: position|constant, diffuse|linear, specular|quadratic, ambient|radius
+//   lightGrid    RG32UI, per cluster the offset into lightIndices and the light count
+//   lightIndices R16UI, the light lists of all clusters back to back
+// With GL 4.3 or ARB_texture_buffer_range the three are written into the frame's StreamBuffer and
+// the textures point at those ranges; otherwise each has its own buffer, orphaned every update.
+class LightClusters {
+public:
+    // have to match the CLUSTER_* defines in saturn.fs and deferred.fs
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // lights over this in a single cluster are dropped, counted in droppedLights
+    static const unsigned int MAX_LIGHTS_PER_CLUSTER = 128;
+    // light indices are 16 bit
+    static const unsigned int MAX_LIGHTS = 65535;
+
+    // statistics of the last update()
+    unsigned int lightCount = 0;
+    unsigned int assignedLights = 0;
+    unsigned int busiestCluster = 0;
+    unsigned int droppedLights = 0;
+    float binningMs = 0.0f;
+
+    LightClusters(WorkerPool& workers, StreamBuffer& stream)
+            : m_Workers(workers), m_Stream(stream) {
+        m_Counts.resize(CLUSTER_COUNT);
+        m_Bins.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+        m_Grid.resize(CLUSTER_COUNT * 2);
+        m_ClusterMin.resize(CLUSTER_COUNT);
+        m_ClusterMax.resize(CLUSTER_COUNT);
+        m_SliceDropped.resize(SLICES);
+
+        for (unsigned int i = 0; i < 3; ++i) {
+            m_Buffers[i] = GLBuffer::create();
+            m_Textures[i] = GLTexture::create();
+            glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i].id());
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            GpuMemory::shared().track(GPU_OBJECT_BUFFER, m_Buffers[i].id(), 16, GPU_MEMORY_STREAMING, "LightClusters");
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i].id());
+            glTexBuffer(GL_TEXTURE_BUFFER, bufferFormat(i), m_Buffers[i].id());
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // bins the lights for this frame's camera and uploads the light data and cluster lists.
+    // projection has to be a symmetric perspective projection with the given near and far plane.
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                float nearPlane, float farPlane) {
+        RG_PROFILE_SCOPE("LightClusters::update");
+        auto start = std::chrono::steady_clock::now();
+        if (projection[0][0] != m_ProjectionX || projection[1][1] != m_ProjectionY
+            || nearPlane != m_Near || farPlane != m_Far)
+            computeClusterBounds(projection[0][0], projection[1][1], nearPlane, farPlane);
+
+        lightCount = (unsigned int) std::min(lights.size(), (size_t) MAX_LIGHTS);
+        m_LightData.resize(lightCount * 4);
+        m_LightBounds.resize(lightCount);
+        for (unsigned int i = 0; i < lightCount; ++i) {
+            const PointLight& light = lights[i];
+            float radius = light.radius();
+            m_LightData[i * 4 + 0] = glm::vec4(light.position, light.constant);
+            m_LightData[i * 4 + 1] = glm::vec4(light.diffuse, light.linear);
+            m_LightData[i * 4 + 2] = glm::vec4(light.specular, light.quadratic);
+            m_LightData[i * 4 + 3] = glm::vec4(light.ambient, radius);
+            m_LightBounds[i] = computeLightBounds(glm::vec3(view * glm::vec4(light.position, 1.0f)), radius);
+        }
+
+        m_Workers.parallelFor(SLICES, [this](unsigned int slice) { binSlice(slice); });
+
+        // pack the fixed size bins into one list
+        m_Indices.clear();
+        busiestCluster = 0;
+        for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; ++cluster) {
+            unsigned int count = m_Counts[cluster];
+            m_Grid[cluster * 2] = (uint32_t) m_Indices.size();
+            m_Grid[cluster * 2 + 1] = count;
+            const uint16_t* bin = &m_Bins[cluster * MAX_LIGHTS_PER_CLUSTER];
+            m_Indices.insert(m_Indices.end(), bin, bin + count);
+            busiestCluster = std::max(busiestCluster, count);
+        }
+        assignedLights = (unsigned int) m_Indices.size();
+        droppedLights = 0;
+        for (unsigned int dropped : m_SliceDropped)
+            droppedLights += dropped;
+
+        upload(0, m_LightData.data(), m_LightData.size() * sizeof(glm::vec4));
+        upload(1, m_Grid.data(), m_Grid.size() * sizeof(uint32_t));
+        upload(2, m_Indices.data(), m_Indices.size() * sizeof(uint16_t));
+        binningMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // binds lightData, lightGrid and lightIndices to texture units firstUnit, firstUnit + 1 and firstUnit + 2
+    void bind(unsigned int firstUnit) const {
+        for (unsigned int i = 0; i < 3; ++i) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i].id());
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // shader has to be in use; viewport is the size the scene is rendered at
+    void setUniforms(Shader& shader, unsigned int firstUnit, int viewportWidth, int viewportHeight) const {
+        shader.setInt("lightData", firstUnit);
+        shader.setInt("lightGrid", firstUnit + 1);
+        shader.setInt("lightIndices", firstUnit + 2);
+        shader.setVec2("clusterTileSize", (float) viewportWidth / TILES_X, (float) viewportHeight / TILES_Y);
+        // slice = log(depth) * scale + bias
+        float scale = SLICES / std::log(m_Far / m_Near);
+        shader.setFloat("clusterSliceScale", scale);
+        shader.setFloat("clusterSliceBias", -scale * std::log(m_Near));
+        shader.setFloat("nearPlane", m_Near);
+        shader.setFloat("farPlane", m_Far);
+    }
+
+private:
+    // cluster range a light touches, empty when sliceMin > sliceMax
+    struct LightBounds {
+        glm::vec3 viewCenter;
+        float radius;
+        int tileMinX, tileMaxX;
+        int tileMinY, tileMaxY;
+        int sliceMin, sliceMax;
+    };
+
+    WorkerPool& m_Workers;
+    StreamBuffer& m_Stream;
+    GLBuffer m_Buffers[3];
+    GLTexture m_Textures[3];
+
+    float m_ProjectionX = 0.0f;
+    float m_ProjectionY = 0.0f;
+    float m_Near = 0.1f;
+    float m_Far = 100.0f;
+    // view space bounding box of every cluster, only changes with the projection
+    std::vector<glm::vec3> m_ClusterMin;
+    std::vector<glm::vec3> m_ClusterMax;
+
+    std::vector<glm::vec4> m_LightData;
+    std::vector<LightBounds> m_LightBounds;
+    std::vector<uint32_t> m_Counts;
+    std::vector<uint16_t> m_Bins;
+    std::vector<unsigned int> m_SliceDropped;
+    std::vector<uint32_t> m_Grid;
+    std::vector<uint16_t> m_Indices;
+
+    float sliceDepth(unsigned int slice) const {
+        return m_Near * std::pow(m_Far / m_Near, (float) slice / SLICES);
+    }
+
+    int sliceOf(float depth) const {
+        if (depth <= m_Near)
+            return 0;
+        int slice = (int) (std::log(depth / m_Near) * SLICES / std::log(m_Far / m_Near));
+        return std::min(slice, (int) SLICES - 1);
+    }
+
+    void computeClusterBounds(float projectionX, float projectionY, float nearPlane, float farPlane) {
+        m_ProjectionX = projectionX;
+        m_ProjectionY = projectionY;
+        m_Near = nearPlane;
+        m_Far = farPlane;
+        for (unsigned int z = 0; z < SLICES; ++z) {
+            float nearDepth = sliceDepth(z);
+            float farDepth = sliceDepth(z + 1);
+            for (unsigned int y = 0; y < TILES_Y; ++y) {
+                float ndcMinY = -1.0f + 2.0f * y / TILES_Y;
+                float ndcMaxY = -1.0f + 2.0f * (y + 1) / TILES_Y;
+                for (unsigned int x = 0; x < TILES_X; ++x) {
+                    float ndcMinX = -1.0f + 2.0f * x / TILES_X;
+                    float ndcMaxX = -1.0f + 2.0f * (x + 1) / TILES_X;
+                    // the tile edges are lines through the eye, so the extremes sit on the near or far face
+                    glm::vec3 boxMin(
+                            std::min(ndcMinX * nearDepth, ndcMinX * farDepth) / projectionX,
+                            std::min(ndcMinY * nearDepth, ndcMinY * farDepth) / projectionY,
+                            -farDepth);
+                    glm::vec3 boxMax(
+                            std::max(ndcMaxX * nearDepth, ndcMaxX * farDepth) / projectionX,
+                            std::max(ndcMaxY * nearDepth, ndcMaxY * farDepth) / projectionY,
+                            -nearDepth);
+                    unsigned int cluster = (z * TILES_Y + y) * TILES_X + x;
+                    m_ClusterMin[cluster] = boxMin;
+                    m_ClusterMax[cluster] = boxMax;
+                }
+            }
+        }
+    }
+
+    LightBounds computeLightBounds(const glm::vec3& viewCenter, float radius) const {
+        LightBounds bounds{viewCenter, radius, 0, (int) TILES_X - 1, 0, (int) TILES_Y - 1, 1, 0};
+        float depth = -viewCenter.z;
+        float nearest = depth - radius;
+        float farthest = depth + radius;
+        if (farthest < m_Near || nearest > m_Far)
+            return bounds;
+
+        // screen rectangle of the sphere's bounding box, the whole screen when it crosses the near plane
+        if (nearest > m_Near) {
+            float ndcMinX = std::min((viewCenter.x - radius) / nearest, (viewCenter.x - radius) / farthest) * m_ProjectionX;
+            float ndcMaxX = std::max((viewCenter.x + radius) / nearest, (viewCenter.x + radius) / farthest) * m_ProjectionX;
+            float ndcMinY = std::min((viewCenter.y - radius) / nearest, (viewCenter.y - radius) / farthest) * m_ProjectionY;
+            float ndcMaxY = std::max((viewCenter.y + radius) / nearest, (viewCenter.y + radius) / farthest) * m_ProjectionY;
+            if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+                return bounds;
+            bounds.tileMinX = tileOf(ndcMinX, TILES_X);
+            bounds.tileMaxX = tileOf(ndcMaxX, TILES_X);
+            bounds.tileMinY = tileOf(ndcMinY, TILES_Y);
+            bounds.tileMaxY = tileOf(ndcMaxY, TILES_Y);
+        }
+        bounds.sliceMin = sliceOf(nearest);
+        bounds.sliceMax = sliceOf(farthest);
+        return bounds;
+    }
+
+    static int tileOf(float ndc, unsigned int tiles) {
+        int tile = (int) std::floor((ndc * 0.5f + 0.5f) * tiles);
+        return std::max(0, std::min(tile, (int) tiles - 1));
+    }
+
+    // runs on the worker pool, writes only the clusters of its own slice
+    void binSlice(unsigned int slice) {
+        unsigned int dropped = 0;
+        uint32_t* counts = &m_Counts[slice * TILES_X * TILES_Y];
+        std::fill(counts, counts + TILES_X * TILES_Y, 0);
+        for (unsigned int i = 0; i < lightCount; ++i) {
+            const LightBounds& light = m_LightBounds[i];
+            if ((int) slice < light.sliceMin || (int) slice > light.sliceMax)
+                continue;
+            for (int y = light.tileMinY; y <= light.tileMaxY; ++y) {
+                for (int x = light.tileMinX; x <= light.tileMaxX; ++x) {
+                    unsigned int cluster = (slice * TILES_Y + y) * TILES_X + x;
+                    // sphere against the cluster's box
+                    glm::vec3 closest = glm::clamp(light.viewCenter, m_ClusterMin[cluster], m_ClusterMax[cluster]);
+                    glm::vec3 offset = closest - light.viewCenter;
+                    if (glm::dot(offset, offset) > light.radius * light.radius)
+                        continue;
+                    uint32_t& count = m_Counts[cluster];
+                    if (count == MAX_LIGHTS_PER_CLUSTER) {
+                        ++dropped;
+                        continue;
+                    }
+                    m_Bins[cluster * MAX_LIGHTS_PER_CLUSTER + count++] = (uint16_t) i;
+                }
+            }
+        }
+        m_SliceDropped[slice] = dropped;
+    }
+
+    static GLenum bufferFormat(unsigned int i) {
+        const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+        return formats[i];
+    }
+
+    void upload(unsigned int i, const void* data, size_t size) {
+        const GLExtensions& extensions = glExtensions();
+        if (extensions.textureBufferRange) {
+            // a texture range can't be empty
+            static const uint32_t empty[4] = {0, 0, 0, 0};
+            if (size == 0) {
+                data = empty;
+                size = sizeof(empty);
+            }
+            StreamBuffer::Allocation allocation = m_Stream.write(data, size, extensions.textureBufferOffsetAlignment);
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i].id());
+            extensions.texBufferRange(GL_TEXTURE_BUFFER, bufferFormat(i), allocation.buffer, allocation.offset, size);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            return;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i].id());
+        // orphan last frame's storage instead of waiting for the draws that still read it
+        glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t) 16), NULL, GL_STREAM_DRAW);
+        GpuMemory::shared().track(GPU_OBJECT_BUFFER, m_Buffers[i].id(), std::max(size, (size_t) 16),
+                                  GPU_MEMORY_STREAMING, "LightClusters");
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif //PROJECT_BASE_LIGHTCLUSTERS_H
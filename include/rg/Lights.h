@@ -0,0 +1,52 @@
+#ifndef PROJECT_BASE_LIGHTS_H
+#define PROJECT_BASE_LIGHTS_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    // distance at which the attenuation brings the brightest channel below 1/256,
+    // the light is treated as having no effect past it
+    float radius() const {
+        glm::vec3 brightest = glm::max(ambient, glm::max(diffuse, specular));
+        float maxChannel = glm::max(brightest.x, glm::max(brightest.y, brightest.z));
+        float c = constant - 256.0f * maxChannel;
+        if (quadratic <= 0.0f)
+            return linear > 0.0f ? -c / linear : 1e6f;
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+    }
+};
+
+struct DirectionalLight {
+    glm::vec3 direction;
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+struct SpotLight {
+    glm::vec3 position;
+    glm::vec3 direction;
+    float cutoff;
+    float outerCutOff;
+
+    glm::vec3 specular;
+    glm::vec3 diffuse;
+    glm::vec3 ambient;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+#endif //PROJECT_BASE_LIGHTS_H
@@ -0,0 +1,181 @@
+#ifndef PROJECT_BASE_OCCLUSIONCULLER_H
+#define PROJECT_BASE_OCCLUSIONCULLER_H
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/GLObject.h>
+#include <rg/GeometryPool.h>
+#include <rg/GpuMemory.h>
+
+// Hardware occlusion culling with a frame of latency.
+//
+// Every object that passes frustum culling gets a GL_ANY_SAMPLES_PASSED query, issued by
+// issueQueries() against the object's bounding box once the frame's opaque depth is in place.
+// The next frame test() looks at that result: when the CPU can already read it and no sample
+// passed, the object isn't submitted at all; when the result is still in flight, the draws are
+// wrapped in a conditional render on the query, so the GPU skips them without the CPU waiting.
+// An object hidden this way still gets its box tested, which brings it back a frame after it
+// becomes visible.
+class OcclusionCuller {
+public:
+    bool enabled = true;
+    // frames an object may go untested before its query object is deleted
+    unsigned int maxIdleFrames = 60;
+
+    // statistics of the current frame
+    unsigned int queriesIssued = 0;
+    // meshes not submitted because last frame's query came back empty
+    unsigned int culledDraws = 0;
+    // meshes drawn under a conditional render, the GPU skips the hidden ones
+    unsigned int conditionalDraws = 0;
+
+    OcclusionCuller() {
+        float vertices[] = {
+                -0.5f, -0.5f, -0.5f,  0.5f, -0.5f, -0.5f,  0.5f, 0.5f, -0.5f,  -0.5f, 0.5f, -0.5f,
+                -0.5f, -0.5f, 0.5f,   0.5f, -0.5f, 0.5f,   0.5f, 0.5f, 0.5f,   -0.5f, 0.5f, 0.5f
+        };
+        unsigned int indices[] = {
+                0, 1, 2, 2, 3, 0,  4, 6, 5, 6, 4, 7,
+                0, 3, 7, 7, 4, 0,  1, 5, 6, 6, 2, 1,
+                0, 4, 5, 5, 1, 0,  3, 2, 6, 6, 7, 3
+        };
+        m_BoxVAO = GLVertexArray::create();
+        m_BoxVBO = GLBuffer::create();
+        m_BoxEBO = GLBuffer::create();
+        glBindVertexArray(m_BoxVAO.id());
+        glBindBuffer(GL_ARRAY_BUFFER, m_BoxVBO.id());
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_BoxEBO.id());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        GpuMemory& memory = GpuMemory::shared();
+        memory.track(GPU_OBJECT_BUFFER, m_BoxVBO.id(), sizeof(vertices), GPU_MEMORY_GEOMETRY, "OcclusionCuller");
+        memory.track(GPU_OBJECT_BUFFER, m_BoxEBO.id(), sizeof(indices), GPU_MEMORY_GEOMETRY, "OcclusionCuller");
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*) 0);
+        glBindVertexArray(0);
+    }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    void beginFrame(const glm::vec3& cameraPosition, float nearPlane) {
+        ++m_Frame;
+        m_CameraPosition = cameraPosition;
+        m_NearPlane = nearPlane;
+        m_FrameEntries.clear();
+        m_Occurrences.clear();
+        queriesIssued = culledDraws = conditionalDraws = 0;
+        for (auto it = m_Entries.begin(); it != m_Entries.end();) {
+            if (m_Frame - it->second.lastFrame > maxIdleFrames) {
+                it = m_Entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // forgets every object and its query. Objects are told apart by address, call it when they are
+    // destroyed, before new ones can take their place and inherit a result that isn't theirs
+    void clear() {
+        m_Entries.clear();
+        m_FrameEntries.clear();
+        m_Occurrences.clear();
+    }
+
+    // object identifies what is drawn, the same object submitted twice in a frame is told apart by order.
+    // Returns the query the object's draws should be conditioned on, 0 to draw them unconditionally;
+    // occluded is set when the object should not be drawn at all.
+    unsigned int test(const void* object, const BoundingBox& worldBounds, bool& occluded) {
+        occluded = false;
+        if (!enabled)
+            return 0;
+        std::pair<const void*, unsigned int> key(object, m_Occurrences[object]++);
+        Entry& entry = m_Entries[key];
+        if (!entry.query)
+            entry.query = GLQuery::create();
+        entry.lastFrame = m_Frame;
+
+        // a little larger than the object, so its own surface never hides the box
+        glm::vec3 center = worldBounds.center();
+        glm::vec3 extents = worldBounds.extents() * 1.01f + glm::vec3(0.001f);
+        entry.boxMin = center - extents;
+        entry.boxMax = center + extents;
+
+        // with the camera inside or against the box, the near plane clips the faces the query needs
+        BoundingBox nearBox;
+        nearBox.min = entry.boxMin - glm::vec3(2.0f * m_NearPlane);
+        nearBox.max = entry.boxMax + glm::vec3(2.0f * m_NearPlane);
+        entry.cameraInside = nearBox.contains(m_CameraPosition);
+        m_FrameEntries.push_back(&entry);
+
+        // only last frame's result says anything about this frame
+        if (entry.cameraInside || entry.issuedFrame == 0 || entry.issuedFrame + 1 != m_Frame)
+            return 0;
+        GLuint available = 0;
+        glGetQueryObjectuiv(entry.query.id(), GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return entry.query.id();
+        GLuint anySamplesPassed = 0;
+        glGetQueryObjectuiv(entry.query.id(), GL_QUERY_RESULT, &anySamplesPassed);
+        occluded = anySamplesPassed == 0;
+        return 0;
+    }
+
+    // tests the boxes of this frame's objects against the depth buffer bound now. Call after the
+    // opaque geometry is drawn; boxShader is a position only shader (depth.vs) with its Camera block bound.
+    void issueQueries(Shader& boxShader) {
+        if (!enabled)
+            return;
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+        glBindVertexArray(m_BoxVAO.id());
+        for (Entry* entry : m_FrameEntries) {
+            if (entry->cameraInside)
+                continue;
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), 0.5f * (entry->boxMin + entry->boxMax));
+            model = glm::scale(model, entry->boxMax - entry->boxMin);
+            GeometryPool::setModelMatrix(model);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, entry->query.id());
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            entry->issuedFrame = m_Frame;
+            ++queriesIssued;
+        }
+        glBindVertexArray(0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+private:
+    struct Entry {
+        GLQuery query;
+        glm::vec3 boxMin = glm::vec3(0.0f);
+        glm::vec3 boxMax = glm::vec3(0.0f);
+        unsigned int lastFrame = 0;
+        // frame whose depth the query result refers to, 0 when never issued
+        unsigned int issuedFrame = 0;
+        bool cameraInside = false;
+    };
+
+    // std::map keeps entry addresses stable while m_FrameEntries points into it
+    std::map<std::pair<const void*, unsigned int>, Entry> m_Entries;
+    std::map<const void*, unsigned int> m_Occurrences;
+    std::vector<Entry*> m_FrameEntries;
+    unsigned int m_Frame = 0;
+    glm::vec3 m_CameraPosition = glm::vec3(0.0f);
+    float m_NearPlane = 0.1f;
+
+    GLVertexArray m_BoxVAO;
+    GLBuffer m_BoxVBO;
+    GLBuffer m_BoxEBO;
+};
+
+#endif //PROJECT_BASE_OCCLUSIONCULLER_H
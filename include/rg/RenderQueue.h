@@ -0,0 +1,425 @@
+#ifndef PROJECT_BASE_RENDERQUEUE_H
+#define PROJECT_BASE_RENDERQUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+#include <rg/CpuProfiler.h>
+#include <rg/GeometryPool.h>
+#include <rg/GLExtensions.h>
+#include <rg/StreamBuffer.h>
+
+// Passes run in this order; the pass sits in the top bits of every key.
+// RENDER_PASS_GBUFFER holds the opaque draws of the deferred path, executed into the g-buffer
+// before the lighting pass; the other passes render into the hdr target.
+enum RenderPass {
+    RENDER_PASS_GBUFFER = 0,
+    RENDER_PASS_OPAQUE = 1,
+    RENDER_PASS_SKYBOX = 2,
+    RENDER_PASS_TRANSPARENT = 3
+};
+
+// Draw used for anything that isn't a Mesh (the skybox), called with the item's userData.
+typedef void (*CustomDrawFunction)(void* userData);
+
+struct RenderItem {
+    Shader* shader;
+    const Mesh* mesh;
+    glm::mat4 model;
+    CustomDrawFunction customDraw;
+    void* userData;
+    // occlusion query the draw is conditioned on, 0 for none
+    unsigned int occlusionQuery;
+};
+
+// Collects the draws of a frame, sorts them by a packed 64-bit key and issues them in that order.
+//
+// Opaque key:      pass:2 | program:8 | texture set:12 | VAO:16 | depth:26
+// Transparent key: pass:2 | inverted depth:26 | program:8 | texture set:12 | VAO:16
+//
+// Opaque draws are grouped by state and go front-to-back within a group, transparent draws go
+// strictly back-to-front. Blending is on for the transparent pass only. With order independent
+// transparency the transparent pass is accumulated weighted-blended instead, in any order, so it
+// takes the opaque key layout and batches like the opaque passes. The key fields are truncated GL
+// names, a collision only costs an extra state change because execute() compares the real names
+// before switching.
+//
+// Meshes all live in the GeometryPool, so with multi-draw indirect a run of draws that shares
+// program and textures is one glMultiDrawElementsIndirect: every draw of the executed passes gets
+// a command and its model matrix written to the frame's StreamBuffer up front, and the command's
+// base instance picks the matrix from the instanced model attribute. Without it every mesh is a
+// glDrawElementsBaseVertex with the model matrix as a generic attribute.
+class RenderQueue {
+public:
+    // when set, opaque depth was already laid down by executeDepthPrepass() and the main pass
+    // only shades the fragments whose depth matches exactly. Alpha-tested meshes are left out of the
+    // pre-pass, whose shader can't discard, and test and write depth themselves
+    bool depthPrepass = false;
+    // batch with glMultiDrawElementsIndirect when the context supports it
+    bool multiDraw = true;
+    // weighted blended OIT: the caller binds the accumulation targets before executing the transparent
+    // pass and resolves them after; its shaders write premultiplied color times weight and alpha
+    bool orderIndependentTransparency = true;
+
+    // statistics of the current frame, depth pre-pass draws included; a multi-draw is one draw call
+    unsigned int drawCalls = 0;
+    unsigned int meshesDrawn = 0;
+    // of the meshes drawn; conditional rendering may still skip some on the GPU
+    unsigned int trianglesDrawn = 0;
+    unsigned int programSwitches = 0;
+    unsigned int textureSwitches = 0;
+    unsigned int vertexArraySwitches = 0;
+
+    void begin(const glm::vec3& cameraPosition, float farPlane) {
+        m_CameraPosition = cameraPosition;
+        m_FarPlane = farPlane;
+        m_Items.clear();
+        m_Keys.clear();
+        m_Sorted = false;
+        std::fill(std::begin(m_PassItems), std::end(m_PassItems), 0u);
+        drawCalls = meshesDrawn = trianglesDrawn = programSwitches = textureSwitches = vertexArraySwitches = 0;
+    }
+
+    explicit RenderQueue(StreamBuffer& stream)
+            : m_Stream(stream) {}
+
+    bool multiDrawActive() const {
+        return multiDraw && glExtensions().multiDrawIndirect;
+    }
+
+    void submit(RenderPass pass, Shader& shader, const Mesh& mesh, const glm::mat4& model, const glm::vec3& worldCenter,
+                unsigned int occlusionQuery = 0) {
+        uint64_t key = makeKey(pass, shader.ID, mesh.textureSetId, mesh.VAO, depthOf(worldCenter));
+        push(key, RenderItem{&shader, &mesh, model, nullptr, nullptr, occlusionQuery});
+    }
+
+    void submitCustom(RenderPass pass, Shader& shader, CustomDrawFunction draw, void* userData) {
+        uint64_t key = makeKey(pass, shader.ID, 0, 0, 0);
+        push(key, RenderItem{&shader, nullptr, glm::mat4(1.0f), draw, userData, 0});
+    }
+
+    size_t size() const {
+        return m_Items.size();
+    }
+
+    unsigned int size(RenderPass pass) const {
+        return m_PassItems[pass];
+    }
+
+    void sort() {
+        if (m_Sorted)
+            return;
+        radixSort(m_Keys, m_Scratch);
+        m_Sorted = true;
+    }
+
+    // draws the opaque and g-buffer meshes with the position only stream into the depth buffer, color writes off.
+    // depthShader has to be bound with the frame's view and projection already set.
+    void executeDepthPrepass(Shader& depthShader) {
+        RG_PROFILE_SCOPE("RenderQueue::executeDepthPrepass");
+        sort();
+        bool batched = prepareMultiDraw(RENDER_PASS_GBUFFER, RENDER_PASS_OPAQUE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        unsigned int currentVAO = 0;
+        for (size_t i = 0; i < m_Keys.size();) {
+            if ((m_Keys[i].key >> 62) > RENDER_PASS_OPAQUE)
+                break;
+            const RenderItem& item = m_Items[m_Keys[i].index];
+            if (!item.mesh || item.mesh->alphaMode == MATERIAL_ALPHA_TESTED) {
+                // keep the multi-draw commands in step
+                if (batched && item.mesh)
+                    ++m_NextCommand;
+                ++i;
+                continue;
+            }
+            if (item.mesh->depthVAO != currentVAO) {
+                glBindVertexArray(item.mesh->depthVAO);
+                currentVAO = item.mesh->depthVAO;
+            }
+            size_t end = batchEnd(i, RENDER_PASS_OPAQUE, batched, true);
+            drawMeshes(i, end, batched);
+            i = end;
+        }
+        glBindVertexArray(0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        GeometryPool::shared().setInstancedModels(false);
+    }
+
+    void execute() {
+        execute(RENDER_PASS_GBUFFER, RENDER_PASS_TRANSPARENT);
+    }
+
+    // draws the queued items of the passes firstPass..lastPass
+    void execute(RenderPass firstPass, RenderPass lastPass) {
+        RG_PROFILE_SCOPE("RenderQueue::execute");
+        sort();
+        bool batched = prepareMultiDraw(firstPass, lastPass);
+
+        int currentPass = -1;
+        bool currentPrepassed = false;
+        unsigned int currentProgram = 0;
+        const Mesh* currentTextures = nullptr;
+        unsigned int currentVAO = 0;
+        for (size_t i = 0; i < m_Keys.size();) {
+            int pass = (int) (m_Keys[i].key >> 62);
+            if (pass < firstPass) {
+                ++i;
+                continue;
+            }
+            if (pass > lastPass)
+                break;
+            const RenderItem& item = m_Items[m_Keys[i].index];
+            if (pass != currentPass) {
+                applyPassState((RenderPass) pass);
+                currentPass = pass;
+                currentPrepassed = depthPrepass;
+            }
+            if (item.shader->ID != currentProgram) {
+                item.shader->use();
+                currentProgram = item.shader->ID;
+                currentTextures = nullptr;
+                ++programSwitches;
+            }
+            if (item.customDraw) {
+                item.customDraw(item.userData);
+                currentTextures = nullptr;
+                currentVAO = 0;
+                ++drawCalls;
+                ++i;
+                continue;
+            }
+
+            const Mesh& mesh = *item.mesh;
+            bool prepassed = depthPrepass && mesh.alphaMode != MATERIAL_ALPHA_TESTED;
+            if (pass <= RENDER_PASS_OPAQUE && prepassed != currentPrepassed) {
+                glDepthMask(prepassed ? GL_FALSE : GL_TRUE);
+                glDepthFunc(prepassed ? GL_EQUAL : GL_LESS);
+                currentPrepassed = prepassed;
+            }
+            if (!currentTextures || currentTextures->textureSetId != mesh.textureSetId) {
+                mesh.BindTextures(*item.shader);
+                currentTextures = &mesh;
+                ++textureSwitches;
+            }
+            if (mesh.VAO != currentVAO) {
+                glBindVertexArray(mesh.VAO);
+                currentVAO = mesh.VAO;
+                ++vertexArraySwitches;
+            }
+            size_t end = batchEnd(i, lastPass, batched, false);
+            drawMeshes(i, end, batched);
+            i = end;
+        }
+
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        glDisable(GL_BLEND);
+        GeometryPool::shared().setInstancedModels(false);
+    }
+
+private:
+    struct SortKey {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<RenderItem> m_Items;
+    std::vector<SortKey> m_Keys;
+    std::vector<SortKey> m_Scratch;
+    // multi-draw commands and model matrices of the passes being executed, in draw order
+    std::vector<DrawElementsIndirectCommand> m_Commands;
+    std::vector<glm::mat4> m_Models;
+    size_t m_NextCommand = 0;
+    // byte offset of m_Commands in the bound draw indirect buffer
+    GLintptr m_CommandOffset = 0;
+    StreamBuffer& m_Stream;
+    glm::vec3 m_CameraPosition = glm::vec3(0.0f);
+    float m_FarPlane = 100.0f;
+    bool m_Sorted = false;
+    unsigned int m_PassItems[4] = {};
+
+    static const unsigned int DEPTH_BITS = 26;
+
+    void push(uint64_t key, const RenderItem& item) {
+        ++m_PassItems[key >> 62];
+        m_Keys.push_back(SortKey{key, (uint32_t) m_Items.size()});
+        m_Items.push_back(item);
+    }
+
+    uint32_t depthOf(const glm::vec3& worldCenter) const {
+        float normalized = glm::length(worldCenter - m_CameraPosition) / m_FarPlane;
+        normalized = glm::clamp(normalized, 0.0f, 1.0f);
+        return (uint32_t) (normalized * ((1u << DEPTH_BITS) - 1));
+    }
+
+    uint64_t makeKey(RenderPass pass, unsigned int program, unsigned int textureSet, unsigned int vao, uint32_t depth) const {
+        uint64_t state = ((uint64_t) (program & 0xFFu) << 28)
+                         | ((uint64_t) (textureSet & 0xFFFu) << 16)
+                         | (uint64_t) (vao & 0xFFFFu);
+        uint64_t key = (uint64_t) pass << 62;
+        if (pass == RENDER_PASS_TRANSPARENT && !orderIndependentTransparency) {
+            uint64_t backToFront = ((1u << DEPTH_BITS) - 1) - depth;
+            key |= (backToFront << 36) | state;
+        } else {
+            key |= (state << DEPTH_BITS) | depth;
+        }
+        return key;
+    }
+
+    // writes a command and model matrix for every mesh of the passes, in the order the passes draw them.
+    // Returns false when the draws go one by one instead.
+    bool prepareMultiDraw(int firstPass, int lastPass) {
+        if (!multiDrawActive())
+            return false;
+        m_Commands.clear();
+        m_Models.clear();
+        for (const SortKey& sortKey : m_Keys) {
+            int pass = (int) (sortKey.key >> 62);
+            if (pass < firstPass)
+                continue;
+            if (pass > lastPass)
+                break;
+            const RenderItem& item = m_Items[sortKey.index];
+            if (!item.mesh)
+                continue;
+            m_Commands.push_back(DrawElementsIndirectCommand{(GLuint) item.mesh->indices.size(), 1,
+                                                             item.mesh->firstIndex, item.mesh->baseVertex,
+                                                             (GLuint) m_Models.size()});
+            m_Models.push_back(item.model);
+        }
+        m_NextCommand = 0;
+        if (m_Commands.empty())
+            return true;
+
+        // base instances count matrices from the start of the buffer
+        StreamBuffer::Allocation models = m_Stream.write(m_Models.data(), m_Models.size() * sizeof(glm::mat4),
+                                                         sizeof(glm::mat4));
+        GLuint firstModel = (GLuint) (models.offset / sizeof(glm::mat4));
+        for (DrawElementsIndirectCommand& command : m_Commands)
+            command.baseInstance += firstModel;
+        StreamBuffer::Allocation commands = m_Stream.write(m_Commands.data(),
+                                                           m_Commands.size() * sizeof(DrawElementsIndirectCommand), 4);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+        m_CommandOffset = commands.offset;
+        GeometryPool& pool = GeometryPool::shared();
+        pool.setModelBuffer(models.buffer);
+        pool.setInstancedModels(true);
+        return true;
+    }
+
+    // end of the run of meshes starting at first that can share one multi-draw: same pass, program,
+    // textures (and with them alpha mode) and vertex array, and no occlusion query since conditional
+    // rendering covers a whole call
+    size_t batchEnd(size_t first, int lastPass, bool batched, bool depthOnly) const {
+        const RenderItem& item = m_Items[m_Keys[first].index];
+        if (!batched || item.occlusionQuery)
+            return first + 1;
+        uint64_t pass = m_Keys[first].key >> 62;
+        size_t end = first + 1;
+        for (; end < m_Keys.size(); ++end) {
+            uint64_t nextPass = m_Keys[end].key >> 62;
+            const RenderItem& next = m_Items[m_Keys[end].index];
+            if ((int) nextPass > lastPass || !next.mesh || next.occlusionQuery)
+                break;
+            if (depthOnly) {
+                if (next.mesh->depthVAO != item.mesh->depthVAO || next.mesh->alphaMode == MATERIAL_ALPHA_TESTED)
+                    break;
+            } else if (nextPass != pass || next.shader->ID != item.shader->ID
+                       || next.mesh->textureSetId != item.mesh->textureSetId || next.mesh->VAO != item.mesh->VAO) {
+                break;
+            }
+        }
+        return end;
+    }
+
+    // draws the meshes first..last with the state of the first. The query holds last frame's box test;
+    // waiting for it only stalls the GPU if it is still behind
+    void drawMeshes(size_t first, size_t last, bool batched) {
+        const RenderItem& item = m_Items[m_Keys[first].index];
+        if (item.occlusionQuery)
+            glBeginConditionalRender(item.occlusionQuery, GL_QUERY_WAIT);
+        if (batched) {
+            glExtensions().multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                                     (void*) (m_CommandOffset + m_NextCommand * sizeof(DrawElementsIndirectCommand)),
+                                                     (GLsizei) (last - first), 0);
+            m_NextCommand += last - first;
+        } else {
+            GeometryPool::setModelMatrix(item.model);
+            item.mesh->DrawElements();
+        }
+        if (item.occlusionQuery)
+            glEndConditionalRender();
+        ++drawCalls;
+        meshesDrawn += last - first;
+        for (size_t k = first; k < last; ++k)
+            trianglesDrawn += (unsigned int) (m_Items[m_Keys[k].index].mesh->indices.size() / 3);
+    }
+
+    void applyPassState(RenderPass pass) const {
+        switch (pass) {
+            case RENDER_PASS_GBUFFER:
+            case RENDER_PASS_OPAQUE:
+                glDepthMask(depthPrepass ? GL_FALSE : GL_TRUE);
+                glDepthFunc(depthPrepass ? GL_EQUAL : GL_LESS);
+                glDisable(GL_BLEND);
+                break;
+            case RENDER_PASS_SKYBOX:
+                // the skybox is drawn at the far plane behind everything
+                glDepthMask(GL_FALSE);
+                glDepthFunc(GL_LEQUAL);
+                glDisable(GL_BLEND);
+                break;
+            case RENDER_PASS_TRANSPARENT:
+                glDepthMask(GL_FALSE);
+                glDepthFunc(GL_LESS);
+                glEnable(GL_BLEND);
+                if (orderIndependentTransparency)
+                    // color and weight add up, alpha multiplies into the revealage
+                    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+                else
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                break;
+        }
+    }
+
+    // LSD radix sort on 8-bit digits; digits that are equal in every key are skipped,
+    // which with few passes and programs removes most of the eight passes
+    static void radixSort(std::vector<SortKey>& keys, std::vector<SortKey>& scratch) {
+        size_t n = keys.size();
+        if (n < 2)
+            return;
+        scratch.resize(n);
+        SortKey* src = keys.data();
+        SortKey* dst = scratch.data();
+        for (unsigned int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for (size_t i = 0; i < n; ++i)
+                ++counts[(src[i].key >> shift) & 0xFF];
+            if (counts[(src[0].key >> shift) & 0xFF] == n)
+                continue;
+
+            size_t offset = 0;
+            for (size_t& count : counts) {
+                size_t c = count;
+                count = offset;
+                offset += c;
+            }
+            for (size_t i = 0; i < n; ++i)
+                dst[counts[(src[i].key >> shift) & 0xFF]++] = src[i];
+            std::swap(src, dst);
+        }
+        if (src != keys.data())
+            keys.swap(scratch);
+    }
+};
+
+#endif //PROJECT_BASE_RENDERQUEUE_H
@@ -0,0 +1,202 @@
+#ifndef PROJECT_BASE_RENDERTARGETPOOL_H
+#define PROJECT_BASE_RENDERTARGETPOOL_H
+
+#include <glad/glad.h>
+#include <map>
+#include <utility>
+#include <vector>
+#include <rg/Error.h>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
+
+// Describes a render target texture. Two targets with the same description are interchangeable,
+// which is what lets the pool hand a texture released by one pass to the next pass that asks for it.
+struct RenderTargetDesc {
+    int width;
+    int height;
+    GLenum internalFormat;
+
+    bool operator<(const RenderTargetDesc& other) const {
+        if (width != other.width)
+            return width < other.width;
+        if (height != other.height)
+            return height < other.height;
+        return internalFormat < other.internalFormat;
+    }
+};
+
+// Pool of 2D render target textures keyed by (size, format).
+// Textures are never deleted when released; they go to a free list and are handed out again
+// to the next acquire() with the same description. Textures that stay unused for more than
+// maxIdleFrames frames (e.g. the old size after a window resize) are deleted in endFrame(). The pool
+// owns every texture it made, acquired ones included; they go to the GLDeletionQueue with it.
+class RenderTargetPool {
+public:
+    unsigned int maxIdleFrames = 3;
+
+    // texture memory of the pool, free textures included, and textures created since start
+    size_t allocatedBytes = 0;
+    unsigned int createdTextures = 0;
+
+    unsigned int acquire(int width, int height, GLenum internalFormat) {
+        RenderTargetDesc desc{width, height, internalFormat};
+        auto it = m_Free.find(desc);
+        GLTexture texture;
+        if (it != m_Free.end()) {
+            texture = std::move(it->second.texture);
+            m_Free.erase(it);
+        } else {
+            texture = createTexture(desc);
+            allocatedBytes += textureBytes(desc);
+            ++createdTextures;
+        }
+        unsigned int name = texture.id();
+        m_Used.emplace(name, UsedEntry{std::move(texture), desc});
+        return name;
+    }
+
+    void release(unsigned int texture) {
+        if (texture == 0)
+            return;
+        auto it = m_Used.find(texture);
+        ASSERT(it != m_Used.end(), "Releasing a texture that was not acquired from the pool");
+        m_Free.emplace(it->second.desc, FreeEntry{std::move(it->second.texture), m_Frame});
+        m_Used.erase(it);
+        m_EvictionExhausted = false;
+    }
+
+    void endFrame() {
+        ++m_Frame;
+        for (auto it = m_Free.begin(); it != m_Free.end();) {
+            if (m_Frame - it->second.releasedFrame > maxIdleFrames) {
+                allocatedBytes -= textureBytes(it->first);
+                it = m_Free.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // deletes the released textures that stayed unused for a whole frame, without waiting for
+    // maxIdleFrames, to get back under a memory budget; returns the bytes freed. Call after endFrame().
+    // A texture released in the frame that just ended may be acquired again by the next one and is kept.
+    // Once a call finds nothing to delete, the next ones return right away until a texture is released
+    size_t evictIdle() {
+        if (m_EvictionExhausted)
+            return 0;
+        size_t freed = 0;
+        bool recentlyReleased = false;
+        for (auto it = m_Free.begin(); it != m_Free.end();) {
+            if (m_Frame - it->second.releasedFrame > 1) {
+                freed += textureBytes(it->first);
+                it = m_Free.erase(it);
+            } else {
+                recentlyReleased = true;
+                ++it;
+            }
+        }
+        allocatedBytes -= freed;
+        m_EvictionExhausted = freed == 0 && !recentlyReleased;
+        return freed;
+    }
+
+    void clear() {
+        m_Free.clear();
+        m_Used.clear();
+        allocatedBytes = 0;
+    }
+
+    size_t allocatedCount() const {
+        return m_Free.size() + m_Used.size();
+    }
+
+    // pixel transfer format and type matching an internal format, needed by glTexImage2D even with no data
+    static void transferFormat(GLenum internalFormat, GLenum& format, GLenum& type) {
+        switch (internalFormat) {
+            case GL_DEPTH24_STENCIL8:
+                format = GL_DEPTH_STENCIL;
+                type = GL_UNSIGNED_INT_24_8;
+                break;
+            case GL_DEPTH_COMPONENT24:
+            case GL_DEPTH_COMPONENT32F:
+                format = GL_DEPTH_COMPONENT;
+                type = GL_FLOAT;
+                break;
+            case GL_R8:
+            case GL_R16F:
+            case GL_R32F:
+                format = GL_RED;
+                type = GL_FLOAT;
+                break;
+            case GL_RG8:
+            case GL_RG16F:
+                format = GL_RG;
+                type = GL_FLOAT;
+                break;
+            case GL_RGB16F:
+            case GL_R11F_G11F_B10F:
+                format = GL_RGB;
+                type = GL_FLOAT;
+                break;
+            case GL_RGBA8:
+                format = GL_RGBA;
+                type = GL_UNSIGNED_BYTE;
+                break;
+            case GL_RGB10_A2:
+                format = GL_RGBA;
+                type = GL_UNSIGNED_INT_2_10_10_10_REV;
+                break;
+            default:
+                format = GL_RGBA;
+                type = GL_FLOAT;
+                break;
+        }
+    }
+
+    static size_t textureBytes(const RenderTargetDesc& desc) {
+        return GpuMemory::textureBytes(desc.internalFormat, desc.width, desc.height);
+    }
+
+    static bool isDepthFormat(GLenum internalFormat) {
+        return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH_COMPONENT24
+               || internalFormat == GL_DEPTH_COMPONENT32F;
+    }
+
+private:
+    struct FreeEntry {
+        GLTexture texture;
+        unsigned int releasedFrame;
+    };
+
+    struct UsedEntry {
+        GLTexture texture;
+        RenderTargetDesc desc;
+    };
+
+    std::multimap<RenderTargetDesc, FreeEntry> m_Free;
+    // keyed by the texture name acquire() handed out
+    std::map<unsigned int, UsedEntry> m_Used;
+    unsigned int m_Frame = 0;
+    // the last evictIdle() found nothing and nothing was released since
+    bool m_EvictionExhausted = false;
+
+    static GLTexture createTexture(const RenderTargetDesc& desc) {
+        GLenum format, type;
+        transferFormat(desc.internalFormat, format, type);
+        GLenum filter = isDepthFormat(desc.internalFormat) ? GL_NEAREST : GL_LINEAR;
+
+        GLTexture texture = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, texture.id());
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GpuMemory::shared().track(GPU_OBJECT_TEXTURE, texture.id(), textureBytes(desc), GPU_MEMORY_RENDER_TARGETS,
+                                  "RenderTargetPool");
+        return texture;
+    }
+};
+
+#endif //PROJECT_BASE_RENDERTARGETPOOL_H
@@ -0,0 +1,61 @@
+#ifndef PROJECT_BASE_RESOLUTIONSCALER_H
+#define PROJECT_BASE_RESOLUTIONSCALER_H
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the fraction of the render target the 3D scene is rendered at, so the measured GPU
+// frame time stays under targetFrameMs. The scale drops as soon as the smoothed frame time goes
+// over budget and only grows again after it has stayed well under budget for a while,
+// which keeps it from oscillating around the budget.
+class ResolutionScaler {
+public:
+    float targetFrameMs = 16.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    // frame time has to be below targetFrameMs * upscaleHeadroom before the scale grows again
+    float upscaleHeadroom = 0.85f;
+    // frames to wait after a change, the effect of a new scale takes a few frames to show up in the timings
+    unsigned int cooldownFrames = 15;
+
+    float scale() const {
+        return m_Scale;
+    }
+
+    float smoothedFrameMs() const {
+        return m_SmoothedMs;
+    }
+
+    void update(float gpuFrameMs) {
+        m_SmoothedMs = m_SmoothedMs == 0.0f ? gpuFrameMs : m_SmoothedMs * 0.9f + gpuFrameMs * 0.1f;
+        if (m_Cooldown > 0) {
+            --m_Cooldown;
+            return;
+        }
+
+        float newScale = m_Scale;
+        if (m_SmoothedMs > targetFrameMs) {
+            // fragment cost is roughly proportional to pixel count, i.e. scale squared
+            newScale = m_Scale * std::sqrt(targetFrameMs / m_SmoothedMs);
+        } else if (m_SmoothedMs < targetFrameMs * upscaleHeadroom) {
+            newScale = m_Scale + 0.05f;
+        }
+        newScale = std::min(std::max(newScale, minScale), maxScale);
+        if (std::abs(newScale - m_Scale) > 0.01f)
+            m_Cooldown = cooldownFrames;
+        m_Scale = newScale;
+    }
+
+    void reset() {
+        m_Scale = maxScale;
+        m_SmoothedMs = 0.0f;
+        m_Cooldown = 0;
+    }
+
+private:
+    float m_Scale = 1.0f;
+    float m_SmoothedMs = 0.0f;
+    unsigned int m_Cooldown = 0;
+};
+
+#endif //PROJECT_BASE_RESOLUTIONSCALER_H
@@ -0,0 +1,351 @@
+#ifndef PROJECT_BASE_SHADOWCASCADES_H
+#define PROJECT_BASE_SHADOWCASCADES_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/CameraBlock.h>
+#include <rg/CpuProfiler.h>
+#include <rg/Frustum.h>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
+#include <rg/GeometryPool.h>
+#include <rg/StreamBuffer.h>
+
+// Cascaded shadow maps for the directional light, with the static casters cached.
+//
+// Every cascade covers a bounding sphere of its slice of the view frustum, enlarged by FIT_SLACK.
+// A cascade is only refitted when its slice leaves that sphere, the light turns or a caster leaves
+// the depth range, so between refits its light projection stays fixed. Static casters are drawn into
+// a cache layer only when the fit changes or invalidateStatic() is called. Every frame the cache is
+// copied into the sampled layer and only the dynamic casters are drawn on top, each culled against
+// the cascade it is drawn into.
+class ShadowCascades {
+public:
+    // has to match SHADOW_CASCADES in saturn.fs and deferred.fs
+    static const unsigned int CASCADES = 3;
+
+    bool enabled = true;
+    // view distance covered by the cascades, nothing further away is shadowed
+    float shadowDistance = 40.0f;
+    // blend between logarithmic (1) and uniform (0) split distances
+    float splitLambda = 0.75f;
+
+    // statistics of the last render()
+    unsigned int staticCascadesRendered = 0;
+    unsigned int castersDrawn = 0;
+    unsigned int castersCulled = 0;
+    // static re-renders since start, a cached frame doesn't add to it
+    unsigned int staticRenderTotal = 0;
+
+    explicit ShadowCascades(int resolution = 2048)
+            : m_Resolution(resolution) {
+        m_ShadowMap = createDepthArray(true);
+        m_StaticMap = createDepthArray(false);
+        for (unsigned int i = 0; i < CASCADES; ++i) {
+            m_ShadowFBO[i] = GLFramebuffer::create();
+            m_StaticFBO[i] = GLFramebuffer::create();
+            attachLayer(m_ShadowFBO[i].id(), m_ShadowMap.id(), i);
+            attachLayer(m_StaticFBO[i].id(), m_StaticMap.id(), i);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ShadowCascades(const ShadowCascades&) = delete;
+    ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+    // forces the cache to be redrawn; static casters that move or appear are picked up by render() anyway
+    void invalidateStatic() {
+        for (Cascade& cascade : m_Cascades)
+            cascade.staticDirty = true;
+    }
+
+    // the caster list is rebuilt every frame, models have to outlive render()
+    void beginFrame() {
+        m_Casters.clear();
+    }
+
+    void addCaster(const Model& model, const glm::mat4& transform, bool isStatic) {
+        m_Casters.push_back(Caster{&model, transform, model.bounds.transformed(transform), isStatic});
+    }
+
+    // fits the cascades to the camera and brings the shadow map up to date. depthShader is a position
+    // only shader (depth.vs), the cascade matrices go to its Camera block through stream; the framebuffer
+    // binding, viewport and Camera block binding are left to the caller to restore.
+    void render(Shader& depthShader, StreamBuffer& stream, const glm::mat4& view, const glm::mat4& projection,
+                float nearPlane, const glm::vec3& lightDirection) {
+        RG_PROFILE_SCOPE("ShadowCascades::render");
+        staticCascadesRendered = castersDrawn = castersCulled = 0;
+        if (!enabled)
+            return;
+
+        glm::vec3 direction = glm::normalize(lightDirection);
+        if (glm::dot(direction, m_LightDirection) < 0.99999f) {
+            m_LightDirection = direction;
+            for (Cascade& cascade : m_Cascades)
+                cascade.radius = 0.0f;
+        }
+        if (staticCastersChanged())
+            invalidateStatic();
+        computeSplits(nearPlane);
+
+        // camera basis of a rigid view matrix
+        glm::mat3 cameraToWorld = glm::transpose(glm::mat3(view));
+        glm::vec3 cameraPosition = -(cameraToWorld * glm::vec3(view[3]));
+
+        depthShader.use();
+        glViewport(0, 0, m_Resolution, m_Resolution);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        for (unsigned int i = 0; i < CASCADES; ++i) {
+            Cascade& cascade = m_Cascades[i];
+            float sliceNear = i == 0 ? nearPlane : m_Splits[i - 1];
+            fit(cascade, cameraPosition, cameraToWorld, projection, sliceNear, m_Splits[i]);
+
+            bindCameraBlock(stream, cascade.view, cascade.projection);
+            if (cascade.staticDirty) {
+                glBindFramebuffer(GL_FRAMEBUFFER, m_StaticFBO[i].id());
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawCasters(depthShader, cascade, true);
+                cascade.staticDirty = false;
+                cascade.shadowHasDynamic = true;
+                ++staticCascadesRendered;
+                ++staticRenderTotal;
+            }
+
+            bool hasDynamic = false;
+            for (const Caster& caster : m_Casters)
+                hasDynamic |= !caster.isStatic && cascade.frustum.intersects(caster.worldBounds);
+            // the sampled layer already equals the cache when nothing dynamic was or is in it
+            if (!hasDynamic && !cascade.shadowHasDynamic)
+                continue;
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_StaticFBO[i].id());
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_ShadowFBO[i].id());
+            glBlitFramebuffer(0, 0, m_Resolution, m_Resolution, 0, 0, m_Resolution, m_Resolution,
+                              GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, m_ShadowFBO[i].id());
+            if (hasDynamic)
+                drawCasters(depthShader, cascade, false);
+            cascade.shadowHasDynamic = hasDynamic;
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void bind(unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_ShadowMap.id());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // shader has to be in use
+    void setUniforms(Shader& shader, unsigned int unit) const {
+        shader.setBool("shadowsEnabled", enabled);
+        shader.setInt("shadowMap", unit);
+        glm::mat4 lightSpaceMatrices[CASCADES];
+        float normalOffsets[CASCADES];
+        for (unsigned int i = 0; i < CASCADES; ++i) {
+            lightSpaceMatrices[i] = m_Cascades[i].projection * m_Cascades[i].view;
+            // about one and a half shadow texels in world units
+            normalOffsets[i] = 3.0f * m_Cascades[i].radius / m_Resolution;
+        }
+        glUniformMatrix4fv(glGetUniformLocation(shader.ID, "lightSpaceMatrices"), CASCADES, GL_FALSE,
+                           glm::value_ptr(lightSpaceMatrices[0]));
+        glUniform1fv(glGetUniformLocation(shader.ID, "cascadeSplits"), CASCADES, m_Splits);
+        glUniform1fv(glGetUniformLocation(shader.ID, "shadowNormalOffsets"), CASCADES, normalOffsets);
+    }
+
+private:
+    // the fitted sphere is this much larger than the slice needs, so small camera moves keep the cache
+    static constexpr float FIT_SLACK = 1.3f;
+
+    struct Caster {
+        const Model* model;
+        glm::mat4 transform;
+        BoundingBox worldBounds;
+        bool isStatic;
+    };
+
+    struct Cascade {
+        glm::vec3 center = glm::vec3(0.0f);
+        // 0 forces a refit
+        float radius = 0.0f;
+        // caster depth range along the light direction, relative to center
+        float depthMin = 0.0f;
+        float depthMax = 0.0f;
+        glm::mat4 view = glm::mat4(1.0f);
+        glm::mat4 projection = glm::mat4(1.0f);
+        Frustum frustum;
+        bool staticDirty = true;
+        bool shadowHasDynamic = false;
+    };
+
+    int m_Resolution;
+    GLTexture m_ShadowMap;
+    GLTexture m_StaticMap;
+    GLFramebuffer m_ShadowFBO[CASCADES];
+    GLFramebuffer m_StaticFBO[CASCADES];
+    Cascade m_Cascades[CASCADES];
+    float m_Splits[CASCADES] = {};
+    glm::vec3 m_LightDirection = glm::vec3(0.0f);
+    std::vector<Caster> m_Casters;
+    // static casters of the frame the cache was last checked against
+    std::vector<Caster> m_StaticCasters;
+
+    GLTexture createDepthArray(bool compare) const {
+        GLTexture texture = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture.id());
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, m_Resolution, m_Resolution, CASCADES, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // linear filtering on a compare texture gives 2x2 pcf for free
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        if (compare) {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        GpuMemory::shared().track(GPU_OBJECT_TEXTURE, texture.id(),
+                                  GpuMemory::textureBytes(GL_DEPTH_COMPONENT32F, m_Resolution, m_Resolution, CASCADES),
+                                  GPU_MEMORY_RENDER_TARGETS, "ShadowCascades");
+        return texture;
+    }
+
+    static void attachLayer(unsigned int fbo, unsigned int texture, unsigned int layer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Shadow framebuffer not complete!" << std::endl;
+    }
+
+    // far distance of every cascade, mixing logarithmic and uniform splits
+    void computeSplits(float nearPlane) {
+        float farPlane = std::max(shadowDistance, nearPlane + 1.0f);
+        for (unsigned int i = 0; i < CASCADES; ++i) {
+            float t = (float) (i + 1) / CASCADES;
+            float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+            float uniform = nearPlane + (farPlane - nearPlane) * t;
+            m_Splits[i] = splitLambda * logarithmic + (1.0f - splitLambda) * uniform;
+        }
+    }
+
+    void fit(Cascade& cascade, const glm::vec3& cameraPosition, const glm::mat3& cameraToWorld,
+             const glm::mat4& projection, float sliceNear, float sliceFar) {
+        // bounding sphere of the frustum slice
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; ++i) {
+            float depth = i < 4 ? sliceNear : sliceFar;
+            float x = (i & 1 ? 1.0f : -1.0f) * depth / projection[0][0];
+            float y = (i & 2 ? 1.0f : -1.0f) * depth / projection[1][1];
+            corners[i] = cameraPosition + cameraToWorld * glm::vec3(x, y, -depth);
+        }
+        glm::vec3 center(0.0f);
+        for (const glm::vec3& corner : corners)
+            center += corner / 8.0f;
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners)
+            radius = std::max(radius, glm::length(corner - center));
+
+        // casters between the light and the receivers have to land in the depth range
+        float casterMin, casterMax;
+        casterDepthRange(cascade.center, radius, casterMin, casterMax);
+
+        bool contained = cascade.radius > 0.0f
+                         && glm::length(center - cascade.center) + radius <= cascade.radius
+                         && radius * FIT_SLACK > 0.7f * cascade.radius
+                         && casterMin >= cascade.depthMin && casterMax <= cascade.depthMax;
+        if (contained)
+            return;
+
+        cascade.center = center;
+        cascade.radius = radius * FIT_SLACK;
+        // recompute against the new center, with room for casters to move
+        casterDepthRange(center, cascade.radius, casterMin, casterMax);
+        float margin = 0.25f * cascade.radius;
+        cascade.depthMin = casterMin - margin;
+        cascade.depthMax = casterMax + margin;
+
+        glm::vec3 up = std::abs(m_LightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 eye = center + m_LightDirection * cascade.depthMin;
+        cascade.view = glm::lookAt(eye, center, up);
+        cascade.projection = glm::ortho(-cascade.radius, cascade.radius, -cascade.radius, cascade.radius,
+                                        0.0f, cascade.depthMax - cascade.depthMin);
+        cascade.frustum = Frustum(cascade.projection * cascade.view);
+        cascade.staticDirty = true;
+    }
+
+    bool staticCastersChanged() {
+        size_t count = 0;
+        bool changed = false;
+        for (const Caster& caster : m_Casters) {
+            if (!caster.isStatic)
+                continue;
+            if (count >= m_StaticCasters.size() || m_StaticCasters[count].model != caster.model
+                || m_StaticCasters[count].transform != caster.transform)
+                changed = true;
+            ++count;
+        }
+        if (!changed && count == m_StaticCasters.size())
+            return false;
+        m_StaticCasters.clear();
+        for (const Caster& caster : m_Casters) {
+            if (caster.isStatic)
+                m_StaticCasters.push_back(caster);
+        }
+        return true;
+    }
+
+    // extent along the light direction, relative to center, of the receiver sphere and every caster
+    void casterDepthRange(const glm::vec3& center, float radius, float& depthMin, float& depthMax) const {
+        depthMin = -radius;
+        depthMax = radius;
+        for (const Caster& caster : m_Casters) {
+            float casterCenter = glm::dot(caster.worldBounds.center() - center, m_LightDirection);
+            float extent = glm::dot(caster.worldBounds.extents(), glm::abs(m_LightDirection));
+            depthMin = std::min(depthMin, casterCenter - extent);
+            depthMax = std::max(depthMax, casterCenter + extent);
+        }
+    }
+
+    void drawCasters(Shader& depthShader, const Cascade& cascade, bool isStatic) {
+        for (const Caster& caster : m_Casters) {
+            if (caster.isStatic != isStatic)
+                continue;
+            if (!cascade.frustum.intersects(caster.worldBounds)) {
+                castersCulled += caster.model->meshes.size();
+                continue;
+            }
+            GeometryPool::setModelMatrix(caster.transform);
+            for (const Mesh& mesh : caster.model->meshes) {
+                if (caster.model->meshes.size() > 1
+                    && !cascade.frustum.intersects(mesh.bounds.transformed(caster.transform))) {
+                    ++castersCulled;
+                    continue;
+                }
+                glBindVertexArray(mesh.depthVAO);
+                mesh.DrawElements();
+                ++castersDrawn;
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_SHADOWCASCADES_H
@@ -0,0 +1,75 @@
+#ifndef PROJECT_BASE_SIMD_H
+#define PROJECT_BASE_SIMD_H
+
+// Minimal float lane type for the CPU rasterizer. The widest instruction set the compiler targets
+// is picked at build time: AVX2 (8 lanes, configure with -DRG_ENABLE_AVX2=ON), SSE2 (4 lanes,
+// always there on x86-64) or a scalar fallback. Masks are lanes with all bits set where true.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace rg {
+namespace simd {
+
+#if defined(__AVX2__)
+
+    typedef __m256 Float;
+    const int WIDTH = 8;
+    const char* const NAME = "AVX2";
+
+    inline Float set1(float v) { return _mm256_set1_ps(v); }
+    inline Float ramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+    inline Float load(const float* p) { return _mm256_loadu_ps(p); }
+    inline void store(float* p, Float v) { _mm256_storeu_ps(p, v); }
+    inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    inline Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    inline Float greaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    inline Float select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+    inline bool any(Float mask) { return _mm256_movemask_ps(mask) != 0; }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+    typedef __m128 Float;
+    const int WIDTH = 4;
+    const char* const NAME = "SSE2";
+
+    inline Float set1(float v) { return _mm_set1_ps(v); }
+    inline Float ramp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+    inline Float load(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, Float v) { _mm_storeu_ps(p, v); }
+    inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    inline Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+    inline Float greaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+    // no blendv before SSE4.1
+    inline Float select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    inline bool any(Float mask) { return _mm_movemask_ps(mask) != 0; }
+
+#else
+
+    typedef float Float;
+    const int WIDTH = 1;
+    const char* const NAME = "scalar";
+
+    inline Float set1(float v) { return v; }
+    inline Float ramp() { return 0.0f; }
+    inline Float load(const float* p) { return *p; }
+    inline void store(float* p, Float v) { *p = v; }
+    inline Float add(Float a, Float b) { return a + b; }
+    inline Float mul(Float a, Float b) { return a * b; }
+    inline Float min(Float a, Float b) { return a < b ? a : b; }
+    // a mask is just 1 or 0 here
+    inline Float greaterEqual(Float a, Float b) { return a >= b ? 1.0f : 0.0f; }
+    inline Float select(Float mask, Float a, Float b) { return mask != 0.0f ? a : b; }
+    inline bool any(Float mask) { return mask != 0.0f; }
+
+#endif
+
+}
+}
+
+#endif //PROJECT_BASE_SIMD_H
@@ -0,0 +1,277 @@
+#ifndef PROJECT_BASE_SOFTWAREOCCLUSION_H
+#define PROJECT_BASE_SOFTWAREOCCLUSION_H
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <rg/Bounds.h>
+#include <rg/CpuProfiler.h>
+#include <rg/Simd.h>
+#include <rg/WorkerPool.h>
+
+// CPU occlusion culling against a low resolution depth buffer.
+//
+// The triangles of a few large occluders are rasterized on the CPU into a WIDTH x HEIGHT buffer of
+// window depth ([0, 1], smaller is closer), and bounding boxes are then tested against it before
+// anything is submitted to GL. Rasterization runs on the worker pool in three steps: vertex transform
+// and triangle setup, both split in chunks, then the screen is cut into horizontal bands and every
+// band job rasterizes all triangles overlapping its rows, so no two jobs write the same pixel.
+// The inner loops work on rg::simd lanes.
+//
+// Occluders cover the pixels whose centers they cover, like GL does, so watertight meshes leave no
+// gaps, but every pixel gets the farthest depth the triangle has in it. The conservative side is the
+// occludee test: its screen rectangle is grown by a pixel, so a box is only hidden when the covered
+// centers around it are all in front. Triangles crossing the near plane are dropped instead of
+// clipped. All of it can only make the occlusion weaker, never hide something visible.
+class SoftwareOcclusion {
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int BAND_ROWS = 8;
+
+    // statistics of the last rasterize()
+    unsigned int occluderTriangles = 0;
+    unsigned int rasterizedTriangles = 0;
+    float rasterMs = 0.0f;
+
+    explicit SoftwareOcclusion(WorkerPool& workers)
+            : m_Workers(workers), m_Depth(WIDTH * HEIGHT, 1.0f) {}
+
+    void beginFrame(const glm::mat4& viewProjection) {
+        m_ViewProjection = viewProjection;
+        m_Occluders.clear();
+        m_VertexCount = 0;
+        occluderTriangles = 0;
+    }
+
+    // all triangles of every mesh of the model occlude; the model has to outlive rasterize()
+    template<typename ModelType>
+    void addOccluder(const ModelType& model, const glm::mat4& transform) {
+        for (const Mesh& mesh : model.meshes)
+            addOccluder(mesh, transform);
+    }
+
+    void addOccluder(const Mesh& mesh, const glm::mat4& transform) {
+        m_Occluders.push_back(Occluder{&mesh, m_ViewProjection * transform, m_VertexCount, occluderTriangles});
+        m_VertexCount += mesh.vertices.size();
+        occluderTriangles += mesh.indices.size() / 3;
+    }
+
+    void rasterize() {
+        RG_PROFILE_SCOPE("SoftwareOcclusion::rasterize");
+        auto start = std::chrono::steady_clock::now();
+        m_Screen.resize(m_VertexCount);
+        m_Triangles.resize(occluderTriangles);
+
+        // chunks of at most CHUNK vertices or triangles of a single occluder
+        m_Chunks.clear();
+        for (unsigned int i = 0; i < m_Occluders.size(); ++i) {
+            unsigned int triangles = m_Occluders[i].mesh->indices.size() / 3;
+            unsigned int chunks = std::max(m_Occluders[i].mesh->vertices.size(), (size_t) triangles);
+            for (unsigned int first = 0; first < chunks; first += CHUNK)
+                m_Chunks.push_back(Chunk{i, first, std::min(first + CHUNK, chunks)});
+        }
+        m_Workers.parallelFor(m_Chunks.size(), [this](unsigned int chunk) { transformChunk(m_Chunks[chunk]); });
+        m_Workers.parallelFor(m_Chunks.size(), [this](unsigned int chunk) { setupChunk(m_Chunks[chunk]); });
+        m_Workers.parallelFor(HEIGHT / BAND_ROWS, [this](unsigned int band) { rasterizeBand(band); });
+
+        rasterizedTriangles = 0;
+        for (const Triangle& triangle : m_Triangles)
+            rasterizedTriangles += triangle.minX <= triangle.maxX;
+        rasterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // false only when every pixel the box covers has an occluder in front of the box's closest point
+    bool isVisible(const BoundingBox& worldBox) const {
+        float minX = FLT_MAX, minY = FLT_MAX;
+        float maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float closest = FLT_MAX;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 corner(i & 1 ? worldBox.max.x : worldBox.min.x,
+                             i & 2 ? worldBox.max.y : worldBox.min.y,
+                             i & 4 ? worldBox.max.z : worldBox.min.z);
+            glm::vec4 clip = m_ViewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w <= MIN_W)
+                return true;
+            glm::vec3 window = toWindow(clip);
+            minX = std::min(minX, window.x);
+            minY = std::min(minY, window.y);
+            maxX = std::max(maxX, window.x);
+            maxY = std::max(maxY, window.y);
+            closest = std::min(closest, window.z);
+        }
+        // one pixel of margin, occluders only cover the pixel centers inside them
+        int x0 = std::max(0, (int) std::floor(minX) - 1);
+        int x1 = std::min(WIDTH - 1, (int) std::floor(maxX) + 1);
+        int y0 = std::max(0, (int) std::floor(minY) - 1);
+        int y1 = std::min(HEIGHT - 1, (int) std::floor(maxY) + 1);
+        if (x0 > x1 || y0 > y1 || closest <= 0.0f)
+            return true;
+
+        // whole lanes are tested, pixels just outside the rectangle can only keep the box visible
+        rg::simd::Float boxDepth = rg::simd::set1(closest);
+        int laneStart = x0 - x0 % rg::simd::WIDTH;
+        for (int y = y0; y <= y1; ++y) {
+            const float* row = &m_Depth[y * WIDTH];
+            for (int x = laneStart; x <= x1; x += rg::simd::WIDTH) {
+                if (rg::simd::any(rg::simd::greaterEqual(rg::simd::load(row + x), boxDepth)))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    const std::vector<float>& depth() const {
+        return m_Depth;
+    }
+
+private:
+    static const unsigned int CHUNK = 2048;
+    // corners closer to the eye than this (clip w) count as crossing the near plane
+    static constexpr float MIN_W = 1e-4f;
+
+    struct Occluder {
+        const Mesh* mesh;
+        glm::mat4 modelViewProjection;
+        unsigned int firstVertex;
+        unsigned int firstTriangle;
+    };
+
+    struct Chunk {
+        unsigned int occluder;
+        unsigned int first;
+        unsigned int last;
+    };
+
+    // edge functions and depth plane in window space, evaluated as a * x + b * y + c;
+    // empty bounds (minX > maxX) when the triangle isn't rasterized
+    struct Triangle {
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, maxX, minY, maxY;
+    };
+
+    WorkerPool& m_Workers;
+    glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+    std::vector<Occluder> m_Occluders;
+    unsigned int m_VertexCount = 0;
+    std::vector<Chunk> m_Chunks;
+    // window x, y, depth and clip w of every occluder vertex
+    std::vector<glm::vec4> m_Screen;
+    std::vector<Triangle> m_Triangles;
+    std::vector<float> m_Depth;
+
+    static glm::vec3 toWindow(const glm::vec4& clip) {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z * 0.5f + 0.5f);
+    }
+
+    void transformChunk(const Chunk& chunk) {
+        const Occluder& occluder = m_Occluders[chunk.occluder];
+        unsigned int last = std::min(chunk.last, (unsigned int) occluder.mesh->vertices.size());
+        for (unsigned int i = chunk.first; i < last; ++i) {
+            glm::vec4 clip = occluder.modelViewProjection * glm::vec4(occluder.mesh->vertices[i].Position, 1.0f);
+            glm::vec4& screen = m_Screen[occluder.firstVertex + i];
+            screen = clip.w > MIN_W ? glm::vec4(toWindow(clip), clip.w) : glm::vec4(0.0f);
+        }
+    }
+
+    void setupChunk(const Chunk& chunk) {
+        const Occluder& occluder = m_Occluders[chunk.occluder];
+        const std::vector<unsigned int>& indices = occluder.mesh->indices;
+        unsigned int last = std::min(chunk.last, (unsigned int) indices.size() / 3);
+        for (unsigned int i = chunk.first; i < last; ++i) {
+            Triangle& triangle = m_Triangles[occluder.firstTriangle + i];
+            triangle.minX = 1;
+            triangle.maxX = 0;
+            glm::vec4 v[3];
+            for (int k = 0; k < 3; ++k)
+                v[k] = m_Screen[occluder.firstVertex + indices[i * 3 + k]];
+            if (v[0].w <= MIN_W || v[1].w <= MIN_W || v[2].w <= MIN_W)
+                continue;
+            float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+            if (std::abs(area) < 1e-6f)
+                continue;
+            // both windings occlude, flip to counter-clockwise so inside is where all edges are positive
+            if (area < 0.0f) {
+                std::swap(v[1], v[2]);
+                area = -area;
+            }
+
+            int minX = std::max(0, (int) std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x))));
+            int maxX = std::min(WIDTH - 1, (int) std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x))));
+            int minY = std::max(0, (int) std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y))));
+            int maxY = std::min(HEIGHT - 1, (int) std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y))));
+            if (minX > maxX || minY > maxY)
+                continue;
+
+            // edge k runs from v[k] to v[k + 1] and weighs the opposite vertex v[k + 2]
+            triangle.depthA = triangle.depthB = triangle.depthC = 0.0f;
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec4& a = v[k];
+                const glm::vec4& b = v[(k + 1) % 3];
+                triangle.edgeA[k] = a.y - b.y;
+                triangle.edgeB[k] = b.x - a.x;
+                triangle.edgeC[k] = a.x * b.y - a.y * b.x;
+                float z = v[(k + 2) % 3].z / area;
+                triangle.depthA += triangle.edgeA[k] * z;
+                triangle.depthB += triangle.edgeB[k] * z;
+                triangle.depthC += triangle.edgeC[k] * z;
+            }
+            // evaluated at pixel centers, the depth plane is moved to its farthest value in the pixel
+            triangle.depthC += 0.5f * (std::abs(triangle.depthA) + std::abs(triangle.depthB));
+            triangle.minX = minX;
+            triangle.maxX = maxX;
+            triangle.minY = minY;
+            triangle.maxY = maxY;
+        }
+    }
+
+    void rasterizeBand(unsigned int band) {
+        int rowStart = band * BAND_ROWS;
+        int rowEnd = rowStart + BAND_ROWS;
+        std::fill(m_Depth.begin() + rowStart * WIDTH, m_Depth.begin() + rowEnd * WIDTH, 1.0f);
+
+        const rg::simd::Float ramp = rg::simd::ramp();
+        const rg::simd::Float zero = rg::simd::set1(0.0f);
+        for (const Triangle& triangle : m_Triangles) {
+            if (triangle.minX > triangle.maxX || triangle.maxY < rowStart || triangle.minY >= rowEnd)
+                continue;
+            int y0 = std::max(triangle.minY, rowStart);
+            int y1 = std::min(triangle.maxY, rowEnd - 1);
+            int laneStart = triangle.minX - triangle.minX % rg::simd::WIDTH;
+            rg::simd::Float a0 = rg::simd::set1(triangle.edgeA[0]);
+            rg::simd::Float a1 = rg::simd::set1(triangle.edgeA[1]);
+            rg::simd::Float a2 = rg::simd::set1(triangle.edgeA[2]);
+            rg::simd::Float depthA = rg::simd::set1(triangle.depthA);
+            for (int y = y0; y <= y1; ++y) {
+                float py = y + 0.5f;
+                rg::simd::Float c0 = rg::simd::set1(triangle.edgeB[0] * py + triangle.edgeC[0]);
+                rg::simd::Float c1 = rg::simd::set1(triangle.edgeB[1] * py + triangle.edgeC[1]);
+                rg::simd::Float c2 = rg::simd::set1(triangle.edgeB[2] * py + triangle.edgeC[2]);
+                rg::simd::Float depthRow = rg::simd::set1(triangle.depthB * py + triangle.depthC);
+                float* row = &m_Depth[y * WIDTH];
+                for (int x = laneStart; x <= triangle.maxX; x += rg::simd::WIDTH) {
+                    rg::simd::Float px = rg::simd::add(ramp, rg::simd::set1(x + 0.5f));
+                    rg::simd::Float e0 = rg::simd::add(rg::simd::mul(a0, px), c0);
+                    rg::simd::Float e1 = rg::simd::add(rg::simd::mul(a1, px), c1);
+                    rg::simd::Float e2 = rg::simd::add(rg::simd::mul(a2, px), c2);
+                    rg::simd::Float inside = rg::simd::greaterEqual(rg::simd::min(e0, rg::simd::min(e1, e2)), zero);
+                    if (!rg::simd::any(inside))
+                        continue;
+                    rg::simd::Float z = rg::simd::add(rg::simd::mul(depthA, px), depthRow);
+                    rg::simd::Float old = rg::simd::load(row + x);
+                    rg::simd::store(row + x, rg::simd::select(inside, rg::simd::min(old, z), old));
+                }
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_SOFTWAREOCCLUSION_H
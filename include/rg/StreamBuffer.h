@@ -0,0 +1,180 @@
+#ifndef PROJECT_BASE_STREAMBUFFER_H
+#define PROJECT_BASE_STREAMBUFFER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <glad/glad.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
+
+// Ring buffer for the data the CPU writes every frame: uniform blocks, draw commands, instance
+// matrices and light lists.
+//
+// The buffer is cut into one region per frame in flight. A frame writes its data one after the
+// other into its region and endFrame() puts a fence behind the frame's commands; when the ring comes
+// back to the region, beginFrame() waits for that fence, so nothing the GPU may still read is
+// overwritten and no write ever synchronizes inside the driver.
+//
+// With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistent and coherent, and a write
+// is a memcpy. Otherwise every write maps its range unsynchronized, which the fences make safe, and
+// instead of waiting on a region the GPU is still behind on the buffer is orphaned.
+class StreamBuffer {
+public:
+    struct Allocation {
+        unsigned int buffer;
+        GLintptr offset;
+    };
+
+    // statistics of the current frame
+    size_t bytesWritten = 0;
+    // time beginFrame() spent waiting for the GPU to release the region
+    float waitMs = 0.0f;
+    // buffers orphaned instead of waited on, and buffer reallocations after a region overflowed; both since start
+    unsigned int orphanCount = 0;
+    unsigned int growCount = 0;
+
+    explicit StreamBuffer(size_t bytesPerFrame = 1 << 20, unsigned int framesInFlight = 3)
+            : m_FramesInFlight(framesInFlight), m_Fences(framesInFlight, nullptr) {
+        m_Persistent = glExtensions().persistentMapping;
+        create(alignUp(bytesPerFrame, REGION_ALIGNMENT));
+    }
+
+    ~StreamBuffer() {
+        for (GLsync& fence : m_Fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+    }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // moves to the next region, waiting until the GPU is done with the frame that used it last
+    void beginFrame() {
+        m_Region = (m_Region + 1) % m_FramesInFlight;
+        m_Head = 0;
+        bytesWritten = 0;
+        waitMs = 0.0f;
+        GLsync& fence = m_Fences[m_Region];
+        if (!fence)
+            return;
+        if (m_Persistent) {
+            auto start = std::chrono::steady_clock::now();
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED)
+                ;
+            waitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        } else if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            // the in-flight frames keep the old storage, every region of the new one is free
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer.id());
+            glBufferData(GL_COPY_WRITE_BUFFER, m_RegionSize * m_FramesInFlight, nullptr, GL_STREAM_DRAW);
+            clearFences();
+            ++orphanCount;
+        }
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    // call after the last command that reads this frame's data
+    void endFrame() {
+        m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copies bytes into the frame's region at an offset aligned to alignment (at most 256).
+    // Bind the returned buffer every time, it changes when a region overflows.
+    Allocation write(const void* data, size_t bytes, size_t alignment = 16) {
+        size_t head = alignUp(m_Head, alignment);
+        if (head + bytes > m_RegionSize) {
+            grow(head + bytes);
+            head = 0;
+        }
+        GLintptr offset = (GLintptr) (m_Region * m_RegionSize + head);
+        if (bytes > 0) {
+            if (m_Persistent) {
+                std::memcpy(m_Mapped + offset, data, bytes);
+            } else {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer.id());
+                void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes, GL_MAP_WRITE_BIT
+                                                | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                std::memcpy(target, data, bytes);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+        }
+        m_Head = head + bytes;
+        bytesWritten += bytes;
+        return Allocation{m_Buffer.id(), offset};
+    }
+
+    bool persistent() const {
+        return m_Persistent;
+    }
+
+    // bytes a frame can write before the buffer has to grow
+    size_t regionSize() const {
+        return m_RegionSize;
+    }
+
+    // bytes of the buffer, every region
+    size_t bufferSize() const {
+        return m_RegionSize * m_FramesInFlight;
+    }
+
+private:
+    static const size_t REGION_ALIGNMENT = 256;
+    static const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+
+    unsigned int m_FramesInFlight;
+    std::vector<GLsync> m_Fences;
+    bool m_Persistent = false;
+    GLBuffer m_Buffer;
+    char* m_Mapped = nullptr;
+    size_t m_RegionSize = 0;
+    unsigned int m_Region = 0;
+    size_t m_Head = 0;
+
+    static size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void create(size_t regionSize) {
+        m_RegionSize = regionSize;
+        size_t size = m_RegionSize * m_FramesInFlight;
+        m_Buffer = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer.id());
+        if (m_Persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glExtensions().bufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            m_Mapped = (char*) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        // an orphaned buffer keeps its size, the driver frees the old storage by itself
+        GpuMemory::shared().track(GPU_OBJECT_BUFFER, m_Buffer.id(), size, GPU_MEMORY_STREAMING, "StreamBuffer");
+    }
+
+    // a region overflowed: the frame continues at the start of its region in a larger buffer
+    void grow(size_t needed) {
+        // the deletion queue keeps the old buffer until the frames bound to it are done
+        m_Buffer.reset();
+        m_Mapped = nullptr;
+        create(alignUp(std::max(needed, m_RegionSize * 2), REGION_ALIGNMENT));
+        // nothing in flight uses the new buffer
+        clearFences();
+        ++growCount;
+    }
+
+    void clearFences() {
+        for (GLsync& fence : m_Fences) {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_STREAMBUFFER_H
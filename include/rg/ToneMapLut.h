@@ -0,0 +1,140 @@
+#ifndef PROJECT_BASE_TONEMAPLUT_H
+#define PROJECT_BASE_TONEMAPLUT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/GLObject.h>
+#include <rg/GpuMemory.h>
+#include <rg/HdrFormat.h>
+
+// log2 range of exposed hdr color the LUT covers; darker clamps to the first texel, which is less
+// than one 8-bit step above black, brighter saturates. Together with SIZE the range keeps trilinear
+// lookups, black included, within one 8-bit step of the exact curve, which the composite's dither hides
+const float TONE_LUT_MIN_LOG2 = -19.0f;
+const float TONE_LUT_MAX_LOG2 = 3.0f;
+
+// grading applied in the LUT, the defaults leave the tone curve alone
+struct ColorGrading {
+    // multiplies the linear color, a white balance
+    glm::vec3 colorFilter = glm::vec3(1.0f);
+    // of the linear color around its luminance
+    float saturation = 1.0f;
+    // of the display color around mid grey
+    float contrast = 1.0f;
+
+    bool operator==(const ColorGrading& other) const {
+        return colorFilter == other.colorFilter && saturation == other.saturation && contrast == other.contrast;
+    }
+
+    bool operator!=(const ColorGrading& other) const {
+        return !(*this == other);
+    }
+};
+
+// The composite's tone curve, gamma and grading baked into a SIZE^3 RGB16F texture.
+//
+// The LUT is indexed by log2 of the exposed hdr color, a log shaper spreads the few texels evenly over
+// the stops instead of spending them on the bright end. The exposure stays a multiply in front of the
+// lookup, it changes every frame with auto exposure, so the LUT is baked again only when the grading
+// changes. The composite is then a log2 and one trilinear fetch per pixel instead of exp and pow.
+class ToneMapLut {
+public:
+    static const int SIZE = 40;
+
+    ColorGrading grading;
+
+    // bakes since start, and the time of the last one
+    unsigned int bakeCount = 0;
+    float bakeMs = 0.0f;
+
+    ToneMapLut() {
+        m_Texture = GLTexture::create();
+        glBindTexture(GL_TEXTURE_3D, m_Texture.id());
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, SIZE, SIZE, SIZE, 0, GL_RGB, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // coordinates outside the range clamp to the first or last texel
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        GpuMemory::shared().track(GPU_OBJECT_TEXTURE, m_Texture.id(),
+                                  GpuMemory::textureBytes(GL_RGB16F, SIZE, SIZE, SIZE), GPU_MEMORY_OTHER, "ToneMapLut");
+    }
+
+    ToneMapLut(const ToneMapLut&) = delete;
+    ToneMapLut& operator=(const ToneMapLut&) = delete;
+
+    // bakes the LUT if the grading changed since the last bake; true if it did
+    bool update() {
+        if (m_Baked && grading == m_BakedGrading)
+            return false;
+        bake();
+        return true;
+    }
+
+    unsigned int texture() const {
+        return m_Texture.id();
+    }
+
+    // texture coordinate of an exposed color c is log2(c) * lutScale + lutOffset
+    template<typename ShaderType>
+    static void setUniforms(const ShaderType& shader) {
+        float texelRange = (float) (SIZE - 1) / SIZE;
+        float scale = texelRange / (TONE_LUT_MAX_LOG2 - TONE_LUT_MIN_LOG2);
+        shader.setFloat("lutScale", scale);
+        shader.setFloat("lutOffset", 0.5f / SIZE - TONE_LUT_MIN_LOG2 * scale);
+    }
+
+private:
+    GLTexture m_Texture;
+    bool m_Baked = false;
+    ColorGrading m_BakedGrading;
+
+    // exposed linear value of texel i along an axis
+    static float texelValue(int i) {
+        return std::exp2(TONE_LUT_MIN_LOG2 + (TONE_LUT_MAX_LOG2 - TONE_LUT_MIN_LOG2) * i / (SIZE - 1));
+    }
+
+    glm::vec3 graded(glm::vec3 color) const {
+        color = color * grading.colorFilter;
+        float luminance = glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+        color = glm::max(glm::mix(glm::vec3(luminance), color, grading.saturation), glm::vec3(0.0f));
+        glm::vec3 display;
+        for (int c = 0; c < 3; c++) {
+            // the exposure is applied before the lookup
+            float tonemapped = tonemappedOutput(color[c], 1.0f) / 255.0f;
+            display[c] = std::min(std::max((tonemapped - 0.5f) * grading.contrast + 0.5f, 0.0f), 1.0f);
+        }
+        return display;
+    }
+
+    void bake() {
+        auto start = std::chrono::steady_clock::now();
+        float axis[SIZE];
+        for (int i = 0; i < SIZE; i++)
+            axis[i] = texelValue(i);
+        std::vector<glm::vec3> texels;
+        texels.reserve(SIZE * SIZE * SIZE);
+        for (int b = 0; b < SIZE; b++) {
+            for (int g = 0; g < SIZE; g++) {
+                for (int r = 0; r < SIZE; r++)
+                    texels.push_back(graded(glm::vec3(axis[r], axis[g], axis[b])));
+            }
+        }
+        glBindTexture(GL_TEXTURE_3D, m_Texture.id());
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, SIZE, SIZE, SIZE, GL_RGB, GL_FLOAT, texels.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        m_BakedGrading = grading;
+        m_Baked = true;
+        ++bakeCount;
+        bakeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#endif //PROJECT_BASE_TONEMAPLUT_H
@@ -0,0 +1,19 @@
+#ifndef PROJECT_BASE_VERTEX_H
+#define PROJECT_BASE_VERTEX_H
+
+#include <glm/glm.hpp>
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+};
+
+#endif //PROJECT_BASE_VERTEX_H
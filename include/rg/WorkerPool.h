@@ -0,0 +1,111 @@
+#ifndef PROJECT_BASE_WORKERPOOL_H
+#define PROJECT_BASE_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <rg/CpuProfiler.h>
+
+// Fixed set of threads that sleep until parallelFor() hands them work.
+// Threads are created once, so splitting a few hundred microseconds of per-frame work
+// across cores doesn't pay for thread creation every frame.
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned int threadCount = defaultThreadCount()) {
+        for (unsigned int i = 0; i < threadCount; ++i)
+            m_Threads.emplace_back([this] { workerLoop(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_WakeUp.notify_all();
+        for (std::thread& thread : m_Threads)
+            thread.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // workers plus the calling thread, which takes part in every parallelFor
+    unsigned int threadCount() const {
+        return m_Threads.size() + 1;
+    }
+
+    // calls job(i) for every i in [0, count) spread over all threads, returns when every call finished
+    void parallelFor(unsigned int count, const std::function<void(unsigned int)>& job) {
+        if (m_Threads.empty() || count < 2) {
+            for (unsigned int i = 0; i < count; ++i)
+                job(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Job = &job;
+            m_Count = count;
+            m_Next = 0;
+            m_Busy = m_Threads.size();
+            ++m_Generation;
+        }
+        m_WakeUp.notify_all();
+        runJobs(job, count);
+
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Done.wait(lock, [this] { return m_Busy == 0; });
+        m_Job = nullptr;
+    }
+
+    static unsigned int defaultThreadCount() {
+        unsigned int cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 0;
+    }
+
+private:
+    std::vector<std::thread> m_Threads;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeUp;
+    std::condition_variable m_Done;
+    const std::function<void(unsigned int)>* m_Job = nullptr;
+    unsigned int m_Count = 0;
+    std::atomic<unsigned int> m_Next{0};
+    unsigned int m_Busy = 0;
+    unsigned long long m_Generation = 0;
+    bool m_Stop = false;
+
+    void runJobs(const std::function<void(unsigned int)>& job, unsigned int count) {
+        RG_PROFILE_SCOPE("WorkerPool::runJobs");
+        for (unsigned int i = m_Next.fetch_add(1); i < count; i = m_Next.fetch_add(1))
+            job(i);
+    }
+
+    void workerLoop() {
+        RG_PROFILE_THREAD("Worker");
+        unsigned long long seenGeneration = 0;
+        while (true) {
+            const std::function<void(unsigned int)>* job;
+            unsigned int count;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_WakeUp.wait(lock, [&] { return m_Stop || m_Generation != seenGeneration; });
+                if (m_Stop)
+                    return;
+                seenGeneration = m_Generation;
+                job = m_Job;
+                count = m_Count;
+            }
+            runJobs(*job, count);
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                if (--m_Busy == 0)
+                    m_Done.notify_one();
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_WORKERPOOL_H
@@ -0,0 +1,28 @@
+#version 330 core
+out float AdaptedLuminance;
+
+// log2 luminance times the coverage, and the coverage
+uniform sampler2D logLuminance;
+uniform sampler2D previousLuminance;
+// mip level of logLuminance that is 1x1
+uniform float topLevel;
+uniform float minLogLuminance;
+uniform float deltaTime;
+uniform float speedUp;
+uniform float speedDown;
+uniform float minAdaptedLuminance;
+// false on the first frame, which takes the measured luminance as it is
+uniform bool primed;
+
+// moves the adapted luminance towards the log average of the covered pixels, the bottom of the range
+// when none is, as exposure.comp does
+void main()
+{
+    vec2 weighted = textureLod(logLuminance, vec2(0.5), topLevel).rg;
+    float average = weighted.g > 0.0 ? exp2(weighted.r / weighted.g) : exp2(minLogLuminance);
+    average = max(average, minAdaptedLuminance);
+    float previous = texelFetch(previousLuminance, ivec2(0), 0).r;
+    float speed = average > previous ? speedUp : speedDown;
+    float weight = primed ? 1.0 - exp(-deltaTime * speed) : 1.0;
+    AdaptedLuminance = previous + (average - previous) * weight;
+}
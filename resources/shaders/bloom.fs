@@ -7,18 +7,39 @@ uniform sampler2D scene;
 uniform sampler2D bloomBlur;
 uniform bool bloom;
 uniform float exposure;
+// divides the exposure by the adapted average luminance, exposure is then that of a scene averaging 1
+uniform bool autoExposure;
+uniform sampler2D adaptedLuminance;
+// tone curve, gamma and grading, indexed by log2 of the exposed color scaled by lutScale and offset by lutOffset
+uniform sampler3D toneMapLut;
+uniform float lutScale;
+uniform float lutOffset;
+// part of the textures covered by the scene, sampling it across the whole screen upscales it
+uniform vec2 uvScale;
+// the same for the blurred bright parts, which may be at a lower resolution
+uniform vec2 bloomUvScale;
+
+// uniform noise in [0, 1) per pixel
+float interleavedGradientNoise(vec2 pixel)
+{
+    return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
 
 void main()
 {
-    const float gamma = 2.2;
-    vec3 hdrColor = texture(scene, TexCoords).rgb;
-    vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
+    vec2 uv = min(TexCoords * uvScale, uvScale - 0.5 / vec2(textureSize(scene, 0)));
+    vec3 hdrColor = texture(scene, uv).rgb;
+    vec2 bloomUv = min(TexCoords * bloomUvScale, bloomUvScale - 0.5 / vec2(textureSize(bloomBlur, 0)));
+    vec3 bloomColor = texture(bloomBlur, bloomUv).rgb;
 
     if(bloom){
         hdrColor += bloomColor;
     }
 
-    vec3 result = vec3(1.0) - exp(-hdrColor * exposure);
-    result = pow(result, vec3(1.0 / gamma));
+    float sceneExposure = autoExposure ? exposure / texelFetch(adaptedLuminance, ivec2(0), 0).r : exposure;
+    vec3 lutCoord = log2(max(hdrColor * sceneExposure, vec3(1e-10))) * lutScale + lutOffset;
+    vec3 result = texture(toneMapLut, lutCoord).rgb;
+    // triangular noise of up to one 8-bit step either way hides the float steps of the packed hdr targets
+    result += (interleavedGradientNoise(gl_FragCoord.xy) + interleavedGradientNoise(gl_FragCoord.xy + vec2(47.0, 17.0)) - 1.0) / 255.0;
     FragColor = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -6,22 +6,32 @@ in vec2 TexCoords;
 uniform sampler2D image;
 
 uniform bool horizontal;
+// part of the texture covered by the scene when rendering at a reduced resolution
+uniform vec2 uvScale;
 uniform float weight[5] = float[] (0.2270270270, 0.1945945946, 0.1216216216, 0.0540540541, 0.0162162162);
 
+vec3 sampleScene(vec2 uv, vec2 maxUV)
+{
+     return texture(image, min(uv, maxUV)).rgb;
+}
+
 void main()
 {
      vec2 tex_offset = 1.0 / textureSize(image, 0);
-     vec3 result = texture(image, TexCoords).rgb * weight[0];
+     // keep taps inside the rendered rectangle so nothing outside it bleeds in
+     vec2 maxUV = uvScale - 0.5 * tex_offset;
+     vec2 uv = TexCoords * uvScale;
+     vec3 result = texture(image, uv).rgb * weight[0];
      if(horizontal) {
          for(int i = 1; i < 5; ++i) {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
+            result += sampleScene(uv + vec2(tex_offset.x * i, 0.0), maxUV) * weight[i];
+            result += sampleScene(uv - vec2(tex_offset.x * i, 0.0), maxUV) * weight[i];
          }
      }
      else {
          for(int i = 1; i < 5; ++i) {
-             result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-             result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
+             result += sampleScene(uv + vec2(0.0, tex_offset.y * i), maxUV) * weight[i];
+             result += sampleScene(uv - vec2(0.0, tex_offset.y * i), maxUV) * weight[i];
          }
      }
      FragColor = vec4(result, 1.0);
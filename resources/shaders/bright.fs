@@ -0,0 +1,19 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+// part of the scene texture covered by the scene
+uniform vec2 uvScale;
+uniform float threshold;
+
+// the parts of the resolved hdr color brighter than threshold, the input of the bloom blur.
+// At half resolution the bilinear tap averages the 2x2 scene pixels of each output pixel
+void main()
+{
+    vec2 uv = min(TexCoords * uvScale, uvScale - 0.5 / vec2(textureSize(scene, 0)));
+    vec3 color = texture(scene, uv).rgb;
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    FragColor = vec4(brightness > threshold ? color : vec3(0.0), 1.0);
+}
@@ -0,0 +1,220 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+
+struct DirectionalLight {
+    vec3 direction;
+
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+struct PointLight {
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+    // lights are only binned to the clusters within this distance
+    float radius;
+};
+
+// clustered light lists, see LightClusters.h; the counts have to match it
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+
+// cascaded shadow map of the directional light, see ShadowCascades.h; has to match it
+#define SHADOW_CASCADES 3
+
+// surface attributes read back from the g-buffer
+struct Surface {
+    vec3 albedo;
+    float specular;
+    float shininess;
+};
+
+in vec2 TexCoords;
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+
+uniform DirectionalLight directionalLight;
+uniform SpotLight ufoLight;
+uniform samplerBuffer lightData;
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+uniform float nearPlane;
+uniform float farPlane;
+uniform bool shadowsEnabled;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 lightSpaceMatrices[SHADOW_CASCADES];
+uniform float cascadeSplits[SHADOW_CASCADES];
+uniform float shadowNormalOffsets[SHADOW_CASCADES];
+
+uniform vec3 viewPosition;
+
+vec3 decodeNormal(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// view space distance of a depth buffer value
+float linearDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+int clusterIndex(vec2 fragCoord, float viewDepth)
+{
+    int slice = clamp(int(log(viewDepth) * clusterSliceScale + clusterSliceBias), 0, CLUSTER_SLICES - 1);
+    ivec2 tile = min(ivec2(fragCoord / clusterTileSize), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+    return (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+}
+
+// 1 where the directional light reaches fragPos, 0 in full shadow
+float CalcShadow(vec3 fragPos, vec3 normal, vec3 lightDir, float viewDepth)
+{
+    if (!shadowsEnabled || viewDepth > cascadeSplits[SHADOW_CASCADES - 1])
+        return 1.0;
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES - 1 && viewDepth > cascadeSplits[cascade])
+        ++cascade;
+    // look up a bit off the surface, more at grazing angles, so it doesn't shadow itself
+    float slope = 1.0 - max(dot(normal, lightDir), 0.0);
+    vec3 offsetPos = fragPos + normal * shadowNormalOffsets[cascade] * (0.5 + slope);
+    vec3 coords = (lightSpaceMatrices[cascade] * vec4(offsetPos, 1.0)).xyz * 0.5 + 0.5;
+    // 3x3 taps of the hardware filtered comparison
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texelSize, float(cascade), coords.z));
+    return lit / 9.0;
+}
+
+PointLight fetchPointLight(int index)
+{
+    vec4 positionConstant = texelFetch(lightData, index * 4);
+    vec4 diffuseLinear = texelFetch(lightData, index * 4 + 1);
+    vec4 specularQuadratic = texelFetch(lightData, index * 4 + 2);
+    vec4 ambientRadius = texelFetch(lightData, index * 4 + 3);
+    return PointLight(positionConstant.xyz, ambientRadius.xyz, diffuseLinear.xyz, specularQuadratic.xyz,
+                      positionConstant.w, diffuseLinear.w, specularQuadratic.w, ambientRadius.w);
+}
+
+vec3 CalcSpotLight(SpotLight light, Surface surface, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    vec3 ambient = light.ambient * surface.albedo;
+
+    // diffuse
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * surface.albedo;
+
+    // specular
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), surface.shininess);
+    vec3 specular = light.specular * spec * surface.specular;
+
+    // spotlight (soft edges)
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = (light.cutOff - light.outerCutOff);
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    diffuse  *= intensity;
+    specular *= intensity;
+
+    // attenuation
+    float distance    = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+vec3 CalcDirectionalLight(DirectionalLight light, Surface surface, vec3 normal, vec3 viewDir, float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), surface.shininess);
+    vec3 ambient = light.ambient * surface.albedo;
+    vec3 diffuse = light.diffuse * diff * surface.albedo;
+    vec3 specular = light.specular * spec * surface.specular;
+    return ambient + (diffuse + specular) * shadow;
+}
+
+vec3 CalcPointLight(PointLight light, Surface surface, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), surface.shininess);
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // fade out towards the cut-off radius instead of popping at the cluster edge
+    float falloff = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
+    return (light.ambient * surface.albedo + light.diffuse * diff * surface.albedo + light.specular * spec * surface.specular) * attenuation;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // nothing was drawn here, the skybox fills it later
+    if (depth == 1.0)
+        discard;
+
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+    Surface surface = Surface(albedoSpec.rgb, albedoSpec.a, normalShininess.b * 256.0);
+    vec3 normal = decodeNormal(normalShininess.rg);
+
+    // world position from the depth buffer
+    vec4 ndc = vec4(gl_FragCoord.xy / viewportSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * ndc;
+    vec3 fragPos = world.xyz / world.w;
+
+    vec3 viewDir = normalize(viewPosition - fragPos);
+    float viewDepth = linearDepth(depth);
+    float shadow = CalcShadow(fragPos, normal, normalize(-directionalLight.direction), viewDepth);
+    vec3 result = CalcDirectionalLight(directionalLight, surface, normal, viewDir, shadow);
+    result += CalcSpotLight(ufoLight, surface, normal, fragPos, viewDir);
+    uvec2 cluster = texelFetch(lightGrid, clusterIndex(gl_FragCoord.xy, viewDepth)).xy;
+    for (uint i = 0u; i < cluster.y; ++i)
+        result += CalcPointLight(fetchPointLight(int(texelFetch(lightIndices, int(cluster.x + i)).r)), surface, normal, fragPos, viewDir);
+
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per draw, instanced from the multi-draw matrices or a generic attribute value (GeometryPool)
+layout (location = 5) in mat4 aModel;
+
+// written once per frame and per shadow cascade (CameraBlock.h)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+
+// must match the lit shaders bit for bit, the main pass tests depth with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    vec3 FragPos = vec3(aModel * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
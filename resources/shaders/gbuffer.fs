@@ -0,0 +1,41 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec4 gNormalShininess;
+
+struct Material {
+    sampler2D texture_diffuse1;
+    float specular;
+
+    float shininess;
+    // set per mesh by Mesh::BindTextures, alphaCutoff is 0 unless the material is alpha-tested
+    float opacity;
+    float alphaCutoff;
+};
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
+
+uniform Material material;
+
+// octahedral normal encoding, two channels instead of three
+vec2 octWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+void main()
+{
+    vec4 base = texture(material.texture_diffuse1, TexCoords);
+    if (base.a * material.opacity < material.alphaCutoff)
+        discard;
+    gAlbedoSpec = vec4(base.rgb, material.specular);
+    // shininess up to 256 fits the 10 bit channel
+    gNormalShininess = vec4(encodeNormal(normalize(Normal)), material.shininess / 256.0, 1.0);
+}
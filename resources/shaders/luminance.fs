@@ -0,0 +1,22 @@
+#version 330 core
+// log2 luminance times the coverage, and the coverage
+out vec2 LogLuminance;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+// part of the scene texture covered by the scene
+uniform vec2 uvScale;
+uniform float minLogLuminance;
+uniform float maxLogLuminance;
+
+// log2 luminance of the scene, downsampled to the square the mip chain averages; pixels darker than
+// the range have no coverage, like bin 0 of histogram.comp
+void main()
+{
+    vec2 uv = min(TexCoords * uvScale, uvScale - 0.5 / vec2(textureSize(scene, 0)));
+    float luminance = dot(texture(scene, uv).rgb, vec3(0.2126, 0.7152, 0.0722));
+    float logLuminance = log2(max(luminance, 1e-6));
+    float coverage = logLuminance < minLogLuminance ? 0.0 : 1.0;
+    LogLuminance = vec2(min(logLuminance, maxLogLuminance) * coverage, coverage);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+
+// weighted blended OIT targets, see RenderQueue::orderIndependentTransparency
+uniform sampler2D accumulation;
+uniform sampler2D weights;
+
+// composited over the hdr color with glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA)
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumulation, pixel, 0);
+    float revealage = accum.a;
+    // nothing translucent covers the pixel
+    if (revealage >= 1.0)
+        discard;
+    float weight = texelFetch(weights, pixel, 0).r;
+    // a half float sum that overflowed falls back to white
+    if (isinf(max(accum.r, max(accum.g, accum.b))))
+        accum.rgb = vec3(weight);
+    vec3 color = accum.rgb / max(weight, 1e-5);
+    FragColor = vec4(color, revealage);
+}
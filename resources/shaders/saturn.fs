@@ -1,6 +1,7 @@
 #version 330 core
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
+// only written in the oit pass, the hdr target has a single color attachment
+layout (location = 1) out vec4 OitWeight;
 
 struct DirectionalLight {
     vec3 direction;
@@ -25,11 +26,36 @@ struct SpotLight {
     float quadratic;
 };
 
+struct PointLight {
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+    // lights are only binned to the clusters within this distance
+    float radius;
+};
+
+// clustered light lists, see LightClusters.h; the counts have to match it
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+
+// cascaded shadow map of the directional light, see ShadowCascades.h; has to match it
+#define SHADOW_CASCADES 3
+
 struct Material {
     sampler2D texture_diffuse1;
-    vec3 specular;
+    float specular;
 
     float shininess;
+    // set per mesh by Mesh::BindTextures, alphaCutoff is 0 unless the material is alpha-tested
+    float opacity;
+    float alphaCutoff;
 };
 in vec2 TexCoords;
 in vec3 Normal;
@@ -37,10 +63,79 @@ in vec3 FragPos;
 
 uniform DirectionalLight directionalLight;
 uniform SpotLight ufoLight;
+uniform samplerBuffer lightData;
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+uniform float nearPlane;
+uniform float farPlane;
+uniform bool shadowsEnabled;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 lightSpaceMatrices[SHADOW_CASCADES];
+uniform float cascadeSplits[SHADOW_CASCADES];
+uniform float shadowNormalOffsets[SHADOW_CASCADES];
 uniform Material material;
 
 uniform vec3 viewPosition;
 
+// weighted blended OIT (RenderQueue::orderIndependentTransparency): the transparent pass writes premultiplied
+// color times weight and alpha to the accumulation target and alpha times weight to the weight target
+uniform bool weightedBlended;
+
+// nearer fragments weigh more; 1 / gl_FragCoord.w is the view depth
+float oitWeight(float alpha)
+{
+    float depth = 1.0 / gl_FragCoord.w;
+    return alpha * clamp(10.0 / (1e-5 + pow(depth / 5.0, 2.0) + pow(depth / 200.0, 6.0)), 1e-2, 3e3);
+}
+
+// view space distance of a depth buffer value
+float linearDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+int clusterIndex(vec2 fragCoord, float viewDepth)
+{
+    int slice = clamp(int(log(viewDepth) * clusterSliceScale + clusterSliceBias), 0, CLUSTER_SLICES - 1);
+    ivec2 tile = min(ivec2(fragCoord / clusterTileSize), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+    return (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+}
+
+// 1 where the directional light reaches fragPos, 0 in full shadow
+float CalcShadow(vec3 fragPos, vec3 normal, vec3 lightDir, float viewDepth)
+{
+    if (!shadowsEnabled || viewDepth > cascadeSplits[SHADOW_CASCADES - 1])
+        return 1.0;
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES - 1 && viewDepth > cascadeSplits[cascade])
+        ++cascade;
+    // look up a bit off the surface, more at grazing angles, so it doesn't shadow itself
+    float slope = 1.0 - max(dot(normal, lightDir), 0.0);
+    vec3 offsetPos = fragPos + normal * shadowNormalOffsets[cascade] * (0.5 + slope);
+    vec3 coords = (lightSpaceMatrices[cascade] * vec4(offsetPos, 1.0)).xyz * 0.5 + 0.5;
+    // 3x3 taps of the hardware filtered comparison
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texelSize, float(cascade), coords.z));
+    return lit / 9.0;
+}
+
+PointLight fetchPointLight(int index)
+{
+    vec4 positionConstant = texelFetch(lightData, index * 4);
+    vec4 diffuseLinear = texelFetch(lightData, index * 4 + 1);
+    vec4 specularQuadratic = texelFetch(lightData, index * 4 + 2);
+    vec4 ambientRadius = texelFetch(lightData, index * 4 + 3);
+    return PointLight(positionConstant.xyz, ambientRadius.xyz, diffuseLinear.xyz, specularQuadratic.xyz,
+                      positionConstant.w, diffuseLinear.w, specularQuadratic.w, ambientRadius.w);
+}
+
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
@@ -74,7 +169,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -86,20 +181,43 @@ vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 fragPos, vec
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = light.specular * spec * material.specular;
-    return (ambient + diffuse + specular);
+    return ambient + (diffuse + specular) * shadow;
 }
 
-void main()
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
+    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 albedo = vec3(texture(material.texture_diffuse1, TexCoords));
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // fade out towards the cut-off radius instead of popping at the cluster edge
+    float falloff = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
+    return (light.ambient * albedo + light.diffuse * diff * albedo + light.specular * spec * material.specular) * attenuation;
+}
 
+void main()
+{
+    float alpha = texture(material.texture_diffuse1, TexCoords).a * material.opacity;
+    if (alpha < material.alphaCutoff)
+        discard;
     vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPosition - FragPos);
-    vec3 result = CalcDirectionalLight(directionalLight, normal, FragPos, viewDir);
+    float viewDepth = linearDepth(gl_FragCoord.z);
+    float shadow = CalcShadow(FragPos, normal, normalize(-directionalLight.direction), viewDepth);
+    vec3 result = CalcDirectionalLight(directionalLight, normal, FragPos, viewDir, shadow);
     result += CalcSpotLight(ufoLight, normal, FragPos, viewDir);
-    float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
-    if (brightness > 1.0)
-        BrightColor = vec4(result, 1.0);
-    else
-        BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
-    FragColor = vec4(result, 1.0);
+    uvec2 cluster = texelFetch(lightGrid, clusterIndex(gl_FragCoord.xy, viewDepth)).xy;
+    for (uint i = 0u; i < cluster.y; ++i)
+        result += CalcPointLight(fetchPointLight(int(texelFetch(lightIndices, int(cluster.x + i)).r)), normal, FragPos, viewDir);
+    if (weightedBlended) {
+        float weight = oitWeight(alpha);
+        FragColor = vec4(result * alpha * weight, alpha);
+        OitWeight = vec4(alpha * weight);
+        return;
+    }
+    FragColor = vec4(result, alpha);
 }
\ No newline at end of file
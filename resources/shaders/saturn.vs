@@ -2,19 +2,28 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per draw, instanced from the multi-draw matrices or a generic attribute value (GeometryPool)
+layout (location = 5) in mat4 aModel;
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// written once per frame and per shadow cascade (CameraBlock.h)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+
+// same position math as depth.vs, so the depth pre-pass result compares GL_EQUAL
+invariant gl_Position;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = aNormal;
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    // world space for the lighting and the shadow normal offset; the models are scaled uniformly, so the
+    // model matrix's rotation does instead of the inverse transpose, the fragment shader normalizes
+    Normal = mat3(aModel) * aNormal;
     TexCoords = aTexCoords;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #version 330 core
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
+// only written in the oit pass, the hdr target has a single color attachment
+layout (location = 1) out vec4 OitWeight;
 
 struct DirectionalLight {
     vec3 direction;
@@ -13,9 +14,12 @@ struct DirectionalLight {
 
 struct Material {
     sampler2D texture_diffuse1;
-    vec3 specular;
+    float specular;
 
     float shininess;
+    // set per mesh by Mesh::BindTextures, alphaCutoff is 0 unless the material is alpha-tested
+    float opacity;
+    float alphaCutoff;
 };
 in vec2 TexCoords;
 in vec3 Normal;
@@ -25,6 +29,17 @@ uniform DirectionalLight directionalLight;
 uniform Material material;
 uniform vec3 ambientLight;
 uniform vec3 viewPosition;
+
+// weighted blended OIT (RenderQueue::orderIndependentTransparency): the transparent pass writes premultiplied
+// color times weight and alpha to the accumulation target and alpha times weight to the weight target
+uniform bool weightedBlended;
+
+// nearer fragments weigh more; 1 / gl_FragCoord.w is the view depth
+float oitWeight(float alpha)
+{
+    float depth = 1.0 / gl_FragCoord.w;
+    return alpha * clamp(10.0 / (1e-5 + pow(depth / 5.0, 2.0) + pow(depth / 200.0, 6.0)), 1e-2, 3e3);
+}
 // calculates the color when using a point light.
 vec3 CalcPointLight(DirectionalLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
@@ -43,11 +58,16 @@ vec3 CalcPointLight(DirectionalLight light, vec3 normal, vec3 fragPos, vec3 view
 
 void main()
 {
-     vec3 ambient = ambientLight * vec3(texture(material.texture_diffuse1, TexCoords));
-     FragColor = vec4(ambient, 1.0);
-     float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
-     if (brightness > 1.0)
-        BrightColor = vec4(FragColor.rgb, 1.0);
-     else
-        BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+     vec4 base = texture(material.texture_diffuse1, TexCoords);
+     float alpha = base.a * material.opacity;
+     if (alpha < material.alphaCutoff)
+        discard;
+     vec3 ambient = ambientLight * base.rgb;
+     if (weightedBlended) {
+        float weight = oitWeight(alpha);
+        FragColor = vec4(ambient * alpha * weight, alpha);
+        OitWeight = vec4(alpha * weight);
+        return;
+     }
+     FragColor = vec4(ambient, alpha);
 }
\ No newline at end of file
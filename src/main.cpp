@@ -13,8 +13,28 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <rg/RenderTargetPool.h>
+#include <rg/GpuTimer.h>
+#include <rg/ResolutionScaler.h>
+#include <rg/RenderQueue.h>
+#include <rg/LightClusters.h>
+#include <rg/ShadowCascades.h>
+#include <rg/GLExtensions.h>
+#include <rg/StreamBuffer.h>
+#include <rg/CameraBlock.h>
+#include <rg/FramePacer.h>
+#include <rg/HdrFormat.h>
+#include <rg/ComputeShader.h>
+#include <rg/AutoExposure.h>
+#include <rg/ToneMapLut.h>
+#include <rg/GpuProfiler.h>
+#include <rg/CpuProfiler.h>
+#include <rg/FrameStats.h>
+#include <rg/GpuMemory.h>
+#include <rg/GLObject.h>
 
 #include <iostream>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
@@ -23,14 +43,38 @@ void processInput(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 unsigned int loadCubemap(vector<std::string> &faces);
 void renderQuad();
+void drawSkybox(void *userData);
+void setLightUniforms(Shader &shader);
+void setWeightedBlended(Shader &ufoShader, Shader &litShader, bool enabled);
+void writeCpuTrace();
+void addLightSwarm(std::vector<PointLight> &lights, int count, float time);
+
+struct RenderTargets;
+void resizeRenderTargets(RenderTargets &targets, RenderTargetPool &pool, int width, int height);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+// first of the three texture units holding the light cluster buffers, above the material textures
+const unsigned int LIGHT_CLUSTER_TEXTURE_UNIT = 8;
+const unsigned int SHADOW_MAP_TEXTURE_UNIT = 11;
 bool hdr = true;
 float exposure = 0.4f;
 bool bloom = true;
 
+// framebuffer size as last reported by GLFW; render targets follow it at a frame boundary
+// once the size has been stable for RESIZE_DEBOUNCE seconds, so live resizing doesn't reallocate every frame
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+double lastResizeTime = 0.0;
+const double RESIZE_DEBOUNCE = 0.2;
+
+// fullscreen quad of renderQuad(), created on first use
+GLVertexArray quadVAO;
+GLBuffer quadVBO;
+
 // camera
 
 float lastX = SCR_WIDTH / 2.0f;
@@ -41,40 +85,6 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-struct PointLight {
-    glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct DirectionalLight {
-    glm::vec3 direction;
-
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-};
-
-struct SpotLight {
-    glm::vec3 position;
-    glm::vec3 direction;
-    float cutoff;
-    float outerCutOff;
-
-    glm::vec3 specular;
-    glm::vec3 diffuse;
-    glm::vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
     bool ImGuiEnabled = false;
@@ -91,6 +101,73 @@ struct ProgramState {
 
     DirectionalLight directionalLight;
     SpotLight ufoSpotLight;
+    std::vector<PointLight> pointLights;
+    // number of small dynamic lights circling saturn on top of pointLights
+    int lightSwarmCount = 128;
+
+    WorkerPool workers;
+    // per frame uniforms, draw commands, instance matrices and light lists
+    StreamBuffer stream;
+    LightClusters lightClusters{workers, stream};
+
+    // cpu depth buffer of saturn and the house, an alternative to the hardware queries
+    bool softwareOcclusionEnabled = false;
+    SoftwareOcclusion softwareOcclusion{workers};
+
+    // directional light shadows, static casters cached between frames
+    ShadowCascades shadows;
+    float shadowMs = 0.0f;
+
+    // dynamic resolution: the scene is rendered into a scaled sub-rectangle of the hdr target
+    bool dynamicResolutionEnabled = true;
+    ResolutionScaler resolutionScaler;
+
+    ViewCuller culler;
+    OcclusionCuller occlusion;
+    RenderQueue renderQueue{stream};
+
+    // frames the cpu may run ahead of the gpu, vsync and the frame rate cap
+    FramePacer pacer;
+
+    // requested format of the color-only hdr targets, RGBA16F is used instead while it would band
+    GLenum hdrFormat = GL_R11F_G11F_B10F;
+    float hdrBandingStep = 0.0f;
+    GLenum activeHdrFormat = GL_R11F_G11F_B10F;
+    // extract and blur the bright parts at half resolution
+    bool halfResolutionBloom = false;
+    // bright pass, blur and composite as compute dispatches when the context has them
+    bool computePost = true;
+    // gpu time of the fragment [0] and compute [1] post-processing, each from the last frame it ran
+    float postMs[2] = {0.0f, 0.0f};
+    // exposure from the adapted average scene luminance
+    AutoExposure autoExposure;
+    float exposureMs = 0.0f;
+    // tone curve, gamma and color grading of the composite, baked when the grading changes
+    ToneMapLut toneMapLut;
+
+    // frame time graph and renderer counters, toggled with F3
+    bool performanceHud = true;
+    FrameStats frameStats;
+    // set by main for the overlay
+    const RenderTargetPool* renderTargetPool = nullptr;
+    // render target textures created and stream buffer reallocations of the last frame
+    unsigned int frameAllocations = 0;
+    // released render targets deleted early to stay within the gpu memory budget, since start
+    size_t evictedBytes = 0;
+    // unload the models and load them again at the start of the next frame, F5
+    bool reloadScene = false;
+
+    // gpu time per pass of the frame
+    GpuProfiler gpuProfiler;
+    std::string gpuProfileStatus;
+
+    // lay down opaque depth with a position only pass, then shade with GL_EQUAL
+    bool depthPrepassEnabled = false;
+    float depthPrepassMs = 0.0f;
+    float mainPassMs = 0.0f;
+
+    // render lit opaque geometry into a g-buffer and light it in a single fullscreen pass
+    bool deferredShading = false;
     ProgramState()
             : camera(glm::vec3(0.0f, 4.0f, 16.0f)) {}
 
@@ -98,11 +175,80 @@ struct ProgramState {
 
 ProgramState *programState;
 
+struct Skybox {
+    GLVertexArray VAO;
+    GLBuffer VBO;
+    GLTexture cubemapTexture;
+};
+
+// the models, unloaded and loaded again as a whole
+struct SceneModels {
+    Model saturn{"resources/objects/saturn/Stylized_Planets.obj"};
+    Model ufo{"resources/objects/ufo/UFO.obj"};
+    Model house{"resources/objects/house/uploads_files_4118883_Orange_Hause.obj"};
+    Model mushroom{"resources/objects/mushroom/Mushrooms1.obj"};
+
+    SceneModels() {
+        saturn.SetShaderTextureNamePrefix("material.");
+        ufo.SetShaderTextureNamePrefix("material.");
+        mushroom.SetShaderTextureNamePrefix("material.");
+    }
+};
+
+// offscreen targets for the hdr scene and the bloom blur, textures come from the RenderTargetPool
+struct RenderTargets {
+    int width = 0;
+    int height = 0;
+    // of the scene color and ping-pong textures
+    GLenum colorFormat = GL_R11F_G11F_B10F;
+    // the bright pass and the blur run at 1 / bloomDivisor of the resolution
+    int bloomDivisor = 1;
+    int bloomWidth = 0;
+    int bloomHeight = 0;
+    GLFramebuffer hdrFBO;
+    unsigned int colorBuffer = 0;
+    unsigned int depthBuffer = 0;
+    GLFramebuffer pingpongFBO[2];
+    unsigned int pingpongColorbuffers[2] = {0, 0};
+    // deferred shading: g-buffer sharing depthBuffer with hdrFBO, and the hdr colors without depth for the lighting pass
+    GLFramebuffer gBufferFBO;
+    unsigned int gAlbedoSpec = 0;
+    unsigned int gNormalShininess = 0;
+    GLFramebuffer lightingFBO;
+    // weighted blended transparency: premultiplied color sum with the revealage in alpha, and the weight sum
+    GLFramebuffer oitFBO;
+    unsigned int oitAccumulation = 0;
+    unsigned int oitWeights = 0;
+    // compute post-processing: the 8-bit composite, blitted to the window; only with compute shaders
+    GLFramebuffer ldrFBO;
+    unsigned int ldrColorBuffer = 0;
+};
+
+// what the render loop draws and measures with besides the scene, released with it before the context goes
+struct RenderResources {
+    RenderTargetPool renderTargetPool;
+    RenderTargets targets;
+    GpuTimer gpuFrameTimer;
+    GpuTimer depthPrepassTimer;
+    GpuTimer mainPassTimer;
+    GpuTimer shadowTimer;
+    GpuTimer postTimers[2];
+    GpuTimer exposureTimer;
+    ComputeShader brightCompute, blurCompute, compositeCompute;
+    ComputeShader histogramCompute, exposureCompute;
+};
+
 void DrawImGui();
+void DrawPerformanceHud();
+void DrawSettings();
 
 int main() {
     // glfw: initialize and configure
     // ------------------------------
+    RG_PROFILE_THREAD("Main");
+    // every instance on a machine can get its own share of the gpu memory
+    if (const char* budget = getenv("RG_GPU_MEMORY_BUDGET_MB"))
+        GpuMemory::shared().budgetBytes = (size_t) std::max(atoi(budget), 0) * 1024 * 1024;
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -125,6 +271,8 @@ int main() {
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
+    // on HiDPI displays the framebuffer is larger than the window
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -134,6 +282,7 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc) glfwGetProcAddress);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(false);
@@ -150,9 +299,7 @@ int main() {
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
-    // blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // blending stays off, the render queue turns it on for the transparent pass only
     // face cull
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
@@ -202,12 +349,13 @@ int main() {
             1.0f, -1.0f,  1.0f
     };
 
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+    Skybox skybox;
+    skybox.VAO = GLVertexArray::create();
+    skybox.VBO = GLBuffer::create();
+    glBindVertexArray(skybox.VAO.id());
+    glBindBuffer(GL_ARRAY_BUFFER, skybox.VBO.id());
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+    GpuMemory::shared().track(GPU_OBJECT_BUFFER, skybox.VBO.id(), sizeof(skyboxVertices), GPU_MEMORY_GEOMETRY, "Skybox");
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
@@ -220,20 +368,19 @@ int main() {
     Shader hdrShader("resources/shaders/hdr.vs","resources/shaders/hdr.fs");    // load models
     Shader bloomShader("resources/shaders/bloom.vs","resources/shaders/bloom.fs");
     Shader blurShader("resources/shaders/blur.vs","resources/shaders/blur.fs");
+    Shader depthShader("resources/shaders/depth.vs", "resources/shaders/depth.fs");
+    Shader gBufferShader("resources/shaders/saturn.vs", "resources/shaders/gbuffer.fs");
+    Shader deferredShader("resources/shaders/deferred.vs", "resources/shaders/deferred.fs");
+    Shader brightShader("resources/shaders/blur.vs", "resources/shaders/bright.fs");
+    Shader oitResolveShader("resources/shaders/deferred.vs", "resources/shaders/oit_resolve.fs");
+    Shader luminanceShader("resources/shaders/blur.vs", "resources/shaders/luminance.fs");
+    Shader adaptShader("resources/shaders/blur.vs", "resources/shaders/adapt.fs");
+    for (Shader* shader : {&ufoShader, &saturnShader, &depthShader, &gBufferShader})
+        shader->setUniformBlock("Camera", CAMERA_BLOCK_BINDING);
 
     // load models
     // -----------
-    Model saturnModel("resources/objects/saturn/Stylized_Planets.obj");
-    saturnModel.SetShaderTextureNamePrefix("material.");
-
-    Model ufoModel("resources/objects/ufo/UFO.obj");
-    ufoModel.SetShaderTextureNamePrefix("material.");
-
-    Model houseModel("resources/objects/house/uploads_files_4118883_Orange_Hause.obj");
-    ufoModel.SetShaderTextureNamePrefix("material.");
-
-    Model mushroomModel("resources/objects/mushroom/Mushrooms1.obj");
-    mushroomModel.SetShaderTextureNamePrefix("material.");
+    std::unique_ptr<SceneModels> scene(new SceneModels());
 
     DirectionalLight& directionalLight = programState->directionalLight;
     directionalLight.direction = glm::vec3(-10.0f, -5.0f, -2.0f);
@@ -253,6 +400,22 @@ int main() {
     ufoSpotLight.linear = 0.35f;
     ufoSpotLight.quadratic = 0.44f;
 
+    // glowing mushroom and a beacon under the ufo
+    PointLight mushroomGlow;
+    mushroomGlow.position = programState->mushroomPosition + glm::vec3(0.0f, 0.3f, 0.0f);
+    mushroomGlow.ambient = glm::vec3(0.0f);
+    mushroomGlow.diffuse = glm::vec3(0.4f, 1.5f, 0.6f);
+    mushroomGlow.specular = glm::vec3(0.5f);
+    mushroomGlow.constant = 1.0f;
+    mushroomGlow.linear = 0.7f;
+    mushroomGlow.quadratic = 1.8f;
+    programState->pointLights.push_back(mushroomGlow);
+
+    PointLight ufoBeacon = mushroomGlow;
+    ufoBeacon.position = programState->ufoPosition - glm::vec3(0.0f, 0.8f, 0.0f);
+    ufoBeacon.diffuse = glm::vec3(1.5f, 0.4f, 0.3f);
+    programState->pointLights.push_back(ufoBeacon);
+
     vector<std::string> faces {
             FileSystem::getPath("resources/textures/skybox/right.png"),
             FileSystem::getPath("resources/textures/skybox/left.png"),
@@ -261,54 +424,27 @@ int main() {
             FileSystem::getPath("resources/textures/skybox/front.png"),
             FileSystem::getPath("resources/textures/skybox/back.png")
     };
-    unsigned int cubemapTexture = loadCubemap(faces);
-
-    unsigned int hdrFBO;
-    glGenFramebuffers(1,&hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    unsigned int colorBuffers[2];
-    glGenTextures(2, colorBuffers);
-
-    for (int i = 0; i < 2; i++) {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
-    }
-
-    unsigned int rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cout<<"SOMETHING AIN'T RIGHT!\n";
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    //blurring
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++) {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
-    }
+    skybox.cubemapTexture = GLTexture::adopt(loadCubemap(faces));
+
+    std::unique_ptr<RenderResources> resources(new RenderResources());
+    RenderTargetPool& renderTargetPool = resources->renderTargetPool;
+    RenderTargets& targets = resources->targets;
+    targets.hdrFBO = GLFramebuffer::create();
+    for (GLFramebuffer& pingpongFBO : targets.pingpongFBO)
+        pingpongFBO = GLFramebuffer::create();
+    targets.gBufferFBO = GLFramebuffer::create();
+    targets.lightingFBO = GLFramebuffer::create();
+    targets.oitFBO = GLFramebuffer::create();
+    targets.ldrFBO = GLFramebuffer::create();
+    resizeRenderTargets(targets, renderTargetPool, framebufferWidth, framebufferHeight);
+    programState->renderTargetPool = &renderTargetPool;
+    GpuTimer& gpuFrameTimer = resources->gpuFrameTimer;
+    GpuTimer& depthPrepassTimer = resources->depthPrepassTimer;
+    GpuTimer& mainPassTimer = resources->mainPassTimer;
+    GpuTimer& shadowTimer = resources->shadowTimer;
+    GpuTimer* postTimers = resources->postTimers;
+    GpuTimer& exposureTimer = resources->exposureTimer;
+    std::vector<PointLight> frameLights;
 
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
@@ -319,15 +455,82 @@ int main() {
     blurShader.use();
     blurShader.setInt("image", 0);
 
+    brightShader.use();
+    brightShader.setInt("scene", 0);
+    brightShader.setFloat("threshold", 1.0f);
+
     bloomShader.use();
     bloomShader.setInt("scene", 0);
     bloomShader.setInt("bloomBlur", 1);
+    bloomShader.setInt("adaptedLuminance", 2);
+    bloomShader.setInt("toneMapLut", 3);
+    ToneMapLut::setUniforms(bloomShader);
+
+    luminanceShader.use();
+    luminanceShader.setInt("scene", 0);
+
+    adaptShader.use();
+    adaptShader.setInt("logLuminance", 0);
+    adaptShader.setInt("previousLuminance", 1);
+
+    deferredShader.use();
+    deferredShader.setInt("gAlbedoSpec", 0);
+    deferredShader.setInt("gNormalShininess", 1);
+    deferredShader.setInt("gDepth", 2);
+
+    oitResolveShader.use();
+    oitResolveShader.setInt("accumulation", 0);
+    oitResolveShader.setInt("weights", 1);
+
+    ComputeShader& brightCompute = resources->brightCompute;
+    ComputeShader& blurCompute = resources->blurCompute;
+    ComputeShader& compositeCompute = resources->compositeCompute;
+    if (glExtensions().computeShaders) {
+        brightCompute.load("resources/shaders/bright.comp");
+        brightCompute.use();
+        brightCompute.setInt("scene", 0);
+        brightCompute.setFloat("threshold", 1.0f);
+        blurCompute.load("resources/shaders/blur.comp");
+        blurCompute.use();
+        blurCompute.setInt("image", 0);
+        compositeCompute.load("resources/shaders/composite.comp");
+        compositeCompute.use();
+        compositeCompute.setInt("scene", 0);
+        compositeCompute.setInt("bloomBlur", 1);
+        compositeCompute.setInt("adaptedLuminance", 2);
+        compositeCompute.setInt("toneMapLut", 3);
+        ToneMapLut::setUniforms(compositeCompute);
+    }
+    ComputeShader& histogramCompute = resources->histogramCompute;
+    ComputeShader& exposureCompute = resources->exposureCompute;
+    if (glExtensions().computeShaders) {
+        histogramCompute.load("resources/shaders/histogram.comp");
+        histogramCompute.use();
+        histogramCompute.setInt("scene", 0);
+        exposureCompute.load("resources/shaders/exposure.comp");
+    }
     // draw in wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
     // render loop
     // -----------
+    int appliedSwapInterval = -1;
+    GLenum checkedHdrFormat = 0;
+    float checkedExposure = -1.0f;
+    unsigned int countedAllocations = 0;
     while (!glfwWindowShouldClose(window)) {
+        RG_PROFILE_SCOPE("Frame");
+        FramePacer& pacer = programState->pacer;
+        if (pacer.swapInterval != appliedSwapInterval) {
+            glfwSwapInterval(pacer.swapInterval);
+            appliedSwapInterval = pacer.swapInterval;
+        }
+        {
+            RG_PROFILE_SCOPE("Frame pacing");
+            pacer.beginFrame();
+        }
+        double workStart = glfwGetTime();
+
         // per-frame time logic
         // --------------------
         float currentFrame = glfwGetTime();
@@ -338,142 +541,464 @@ int main() {
         // -----
         processInput(window);
 
+        if (programState->reloadScene) {
+            // the old objects go to the deletion queue, the new meshes reuse the old pool ranges
+            scene.reset();
+            Mesh::ReleaseTextureSets();
+            scene.reset(new SceneModels());
+            programState->shadows.invalidateStatic();
+            programState->occlusion.clear();
+            programState->reloadScene = false;
+        }
+        Model& saturnModel = scene->saturn;
+        Model& ufoModel = scene->ufo;
+        Model& houseModel = scene->house;
+        Model& mushroomModel = scene->mushroom;
+
+        // validate the hdr format whenever it or the exposure changes, for the largest exposure auto
+        // exposure can adapt to
+        float maxExposure = programState->autoExposure.maxExposure(exposure);
+        if (programState->hdrFormat != checkedHdrFormat || maxExposure != checkedExposure) {
+            programState->hdrBandingStep = worstBandingStep(programState->hdrFormat, maxExposure);
+            checkedHdrFormat = programState->hdrFormat;
+            checkedExposure = maxExposure;
+        }
+        programState->activeHdrFormat = programState->hdrBandingStep <= BANDING_LIMIT ? programState->hdrFormat : GL_RGBA16F;
+        int bloomDivisor = programState->halfResolutionBloom ? 2 : 1;
+        if (programState->activeHdrFormat != targets.colorFormat || bloomDivisor != targets.bloomDivisor) {
+            targets.colorFormat = programState->activeHdrFormat;
+            targets.bloomDivisor = bloomDivisor;
+            resizeRenderTargets(targets, renderTargetPool, targets.width, targets.height);
+        }
+
+        // apply a pending resize only between frames, after the size settled
+        if ((framebufferWidth != targets.width || framebufferHeight != targets.height)
+            && framebufferWidth > 0 && framebufferHeight > 0
+            && glfwGetTime() - lastResizeTime > RESIZE_DEBOUNCE) {
+            resizeRenderTargets(targets, renderTargetPool, framebufferWidth, framebufferHeight);
+        }
+
+        // pick the scene resolution from the gpu time of a previous frame
+        ResolutionScaler& resolutionScaler = programState->resolutionScaler;
+        if (programState->dynamicResolutionEnabled && gpuFrameTimer.hasResult())
+            resolutionScaler.update(gpuFrameTimer.milliseconds());
+        float renderScale = programState->dynamicResolutionEnabled ? resolutionScaler.scale() : 1.0f;
+        int sceneWidth = std::max(1, (int) (targets.width * renderScale));
+        int sceneHeight = std::max(1, (int) (targets.height * renderScale));
+        // part of the hdr and blur textures that holds the scene, used to upscale in the composite
+        glm::vec2 uvScale((float) sceneWidth / targets.width, (float) sceneHeight / targets.height);
+        int bloomSceneWidth = std::max(1, sceneWidth / targets.bloomDivisor);
+        int bloomSceneHeight = std::max(1, sceneHeight / targets.bloomDivisor);
+        glm::vec2 bloomUvScale((float) bloomSceneWidth / targets.bloomWidth, (float) bloomSceneHeight / targets.bloomHeight);
+
+        gpuFrameTimer.begin();
+        GpuProfiler& profiler = programState->gpuProfiler;
+        profiler.beginFrame();
+        StreamBuffer& stream = programState->stream;
+        stream.beginFrame();
 
         // render
         // ------
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        bool deferred = programState->deferredShading;
+        glBindFramebuffer(GL_FRAMEBUFFER, deferred ? targets.gBufferFBO.id() : targets.hdrFBO.id());
+        glViewport(0, 0, sceneWidth, sceneHeight);
         glEnable(GL_DEPTH_TEST);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-        // don't forget to enable shader before setting uniforms
-        ufoShader.use();
-        ufoShader.setVec3("directionalLight.direction", directionalLight.direction);
-        ufoShader.setVec3("directionalLight.ambient", 1.5f, 1.5f, 1.7f);
-        ufoShader.setVec3("directionalLight.diffuse", directionalLight.diffuse);
-        ufoShader.setVec3("directionalLight.specular", directionalLight.specular);
-        ufoShader.setVec3("viewPosition", programState->camera.Position);
-        ufoShader.setFloat("material.shininess", 32.0f);
-        ufoShader.setFloat("material.specular", 0.05f);
-        ufoShader.setVec3("ambientLight", glm::vec3(3.0f));
+        {
+            RG_PROFILE_SCOPE("Uniform setup");
+            // don't forget to enable shader before setting uniforms
+            ufoShader.use();
+            ufoShader.setVec3("directionalLight.direction", directionalLight.direction);
+            ufoShader.setVec3("directionalLight.ambient", 1.5f, 1.5f, 1.7f);
+            ufoShader.setVec3("directionalLight.diffuse", directionalLight.diffuse);
+            ufoShader.setVec3("directionalLight.specular", directionalLight.specular);
+            ufoShader.setVec3("viewPosition", programState->camera.Position);
+            ufoShader.setFloat("material.shininess", 32.0f);
+            ufoShader.setFloat("material.specular", 0.05f);
+            ufoShader.setVec3("ambientLight", glm::vec3(3.0f));
+        }
 
         // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),(float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),(float) targets.width / (float) targets.height, NEAR_PLANE, FAR_PLANE);
         glm::mat4 view = programState->camera.GetViewMatrix();
-        ufoShader.setMat4("projection", projection);
-        ufoShader.setMat4("view", view);
+        ViewCuller& culler = programState->culler;
+        culler.setView(projection, view, sceneHeight);
+
+        // model matrices of the static scene
+        glm::mat4 saturnMatrix = glm::mat4(1.0f);
+        saturnMatrix = glm::translate(saturnMatrix,programState->saturnPosition); // translate it down so it's at the center of the scene
+        saturnMatrix = glm::scale(saturnMatrix, glm::vec3(programState->saturnScale));    // it's a bit too big for our scene, so scale it down
+        glm::mat4 houseMatrix = glm::mat4(1.0f);
+        houseMatrix = glm::translate(houseMatrix,programState->housePosition); // translate it down so it's at the center of the scene
+        houseMatrix = glm::scale(houseMatrix, glm::vec3(programState->houseScale));    // it's a bit too big for our scene, so scale it down
+        houseMatrix = glm::rotate(houseMatrix, glm::radians(-12.0f), glm::vec3(0.0, 0.0, 1.0));
+        houseMatrix = glm::rotate(houseMatrix, glm::radians(-45.0f), glm::vec3(0.0, 1.0, 0.0));
+        glm::mat4 mushroomMatrix = glm::mat4(1.0f);
+        mushroomMatrix = glm::translate(mushroomMatrix,programState->mushroomPosition); // translate it down so it's at the center of the scene
+        mushroomMatrix = glm::scale(mushroomMatrix, glm::vec3(programState->mushroomScale));    // it's a bit too big for our scene, so scale it down
+        mushroomMatrix = glm::rotate(mushroomMatrix, glm::radians(10.0f), glm::vec3(0.0, 0.0, 1.0));
+
+        // rasterize the big occluders on the CPU, everything submitted below is tested against them
+        culler.softwareOcclusion = nullptr;
+        if (programState->softwareOcclusionEnabled) {
+            SoftwareOcclusion& softwareOcclusion = programState->softwareOcclusion;
+            softwareOcclusion.beginFrame(projection * view);
+            softwareOcclusion.addOccluder(saturnModel, saturnMatrix);
+            softwareOcclusion.addOccluder(houseModel, houseMatrix);
+            softwareOcclusion.rasterize();
+            culler.softwareOcclusion = &softwareOcclusion;
+        }
 
-        // render the ufo model
+        // bin this frame's point lights into the view's clusters
+        frameLights.assign(programState->pointLights.begin(), programState->pointLights.end());
+        addLightSwarm(frameLights, programState->lightSwarmCount, currentFrame);
+        LightClusters& lightClusters = programState->lightClusters;
+        lightClusters.update(frameLights, view, projection, NEAR_PLANE, FAR_PLANE);
+        lightClusters.bind(LIGHT_CLUSTER_TEXTURE_UNIT);
+        RenderQueue& renderQueue = programState->renderQueue;
+        bool oit = renderQueue.orderIndependentTransparency;
+        renderQueue.begin(programState->camera.Position, FAR_PLANE);
+        OcclusionCuller& occlusion = programState->occlusion;
+        occlusion.beginFrame(programState->camera.Position, NEAR_PLANE);
+        ShadowCascades& shadows = programState->shadows;
+        shadows.beginFrame();
+
+        // queue the ufo model
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model,programState->ufoPosition); // translate it down so it's at the center of the scene
         model = glm::scale(model, glm::vec3(programState->ufoScale));    // it's a bit too big for our scene, so scale it down
         model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0, 0.0, 1.0));
         model = glm::rotate(model, glm::radians(float(20 * (glfwGetTime()))), glm::vec3(0.0, 1.0, 0.0));
-        ufoShader.setMat4("model", model);
-        ufoModel.Draw(ufoShader);
+        ufoModel.Submit(renderQueue, ufoShader, model, culler, RENDER_PASS_OPAQUE, &occlusion);
+        shadows.addCaster(ufoModel, model, false);
 
-        saturnShader.use();
-        saturnShader.setVec3("directionalLight.direction", directionalLight.direction);
-        saturnShader.setVec3("directionalLight.ambient", directionalLight.ambient);
-        saturnShader.setVec3("directionalLight.diffuse", directionalLight.diffuse);
-        saturnShader.setVec3("directionalLight.specular", directionalLight.specular);
-        saturnShader.setVec3("ufoLight.ambient", ufoSpotLight.ambient);
-        saturnShader.setVec3("ufoLight.diffuse", ufoSpotLight.diffuse);
-        saturnShader.setVec3("ufoLight.specular", ufoSpotLight.specular);
-        saturnShader.setVec3("ufoLight.position", programState->ufoPosition);
-        saturnShader.setVec3("ufoLight.direction", glm::vec3(sin(glfwGetTime()) * 1.2f,-1.0f,cos(glfwGetTime()) * 1.5f) - programState->ufoPosition);
-        saturnShader.setFloat("ufoLight.cutOff", ufoSpotLight.cutoff);
-        saturnShader.setFloat("ufoLight.outerCutOff", ufoSpotLight.outerCutOff);
-        saturnShader.setFloat("ufoLight.constant", ufoSpotLight.constant);
-        saturnShader.setFloat("ufoLight.linear", ufoSpotLight.linear);
-        saturnShader.setFloat("ufoLight.quadratic", ufoSpotLight.quadratic);
+        ufoSpotLight.position = programState->ufoPosition;
+        ufoSpotLight.direction = glm::vec3(sin(glfwGetTime()) * 1.2f,-1.0f,cos(glfwGetTime()) * 1.5f) - programState->ufoPosition;
 
+        // lit geometry goes either straight to the hdr target or into the g-buffer
+        // translucent meshes can't go to the g-buffer, they are shaded forward in either path
+        Shader& litShader = deferred ? gBufferShader : saturnShader;
+        RenderPass litPass = deferred ? RENDER_PASS_GBUFFER : RENDER_PASS_OPAQUE;
+        saturnShader.use();
+        setLightUniforms(saturnShader);
+        programState->lightClusters.setUniforms(saturnShader, LIGHT_CLUSTER_TEXTURE_UNIT, sceneWidth, sceneHeight);
+        shadows.setUniforms(saturnShader, SHADOW_MAP_TEXTURE_UNIT);
         saturnShader.setVec3("viewPosition", programState->camera.Position);
         saturnShader.setFloat("material.shininess", 32.0f);
         saturnShader.setFloat("material.specular", 0.05f);
-        saturnShader.setMat4("projection", projection);
-        saturnShader.setMat4("view", view);
-
-        // render the saturn model
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,programState->saturnPosition); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(programState->saturnScale));    // it's a bit too big for our scene, so scale it down
-        saturnShader.setMat4("model", model);
-        saturnModel.Draw(saturnShader);
-
-        // render the house model
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,programState->housePosition); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(programState->houseScale));    // it's a bit too big for our scene, so scale it down
-        model = glm::rotate(model, glm::radians(-12.0f), glm::vec3(0.0, 0.0, 1.0));
-        model = glm::rotate(model, glm::radians(-45.0f), glm::vec3(0.0, 1.0, 0.0));
-        saturnShader.setMat4("model", model);
-        houseModel.Draw(saturnShader);
-
-        // render mushroom model
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,programState->mushroomPosition); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(programState->mushroomScale));    // it's a bit too big for our scene, so scale it down
-        model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0, 0.0, 1.0));
-        saturnShader.setMat4("model", model);
-        mushroomModel.Draw(saturnShader);
+        if (deferred) {
+            gBufferShader.use();
+            gBufferShader.setFloat("material.shininess", 32.0f);
+            gBufferShader.setFloat("material.specular", 0.05f);
+        }
+
+        // queue the saturn model
+        saturnModel.Submit(renderQueue, litShader, saturnMatrix, culler, litPass, &occlusion, &saturnShader);
+        shadows.addCaster(saturnModel, saturnMatrix, true);
 
+        // queue the house model
+        houseModel.Submit(renderQueue, litShader, houseMatrix, culler, litPass, &occlusion, &saturnShader);
+        shadows.addCaster(houseModel, houseMatrix, true);
 
-        // draw skyboxa
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);
+        // queue mushroom model
+        mushroomModel.Submit(renderQueue, litShader, mushroomMatrix, culler, litPass, &occlusion, &saturnShader);
+        shadows.addCaster(mushroomModel, mushroomMatrix, true);
+
+        // queue skybox, drawn after the opaque geometry
         skyboxShader.use();
         view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
         skyboxShader.setMat4("view", view);
         skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
-        glDepthMask(GL_TRUE);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        bool horizontal = true, first_iteration = true;
-        int amount = 10;
-        blurShader.use();
-        for (int i = 0; i < amount; i++) {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            blurShader.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);
+        renderQueue.submitCustom(RENDER_PASS_SKYBOX, skyboxShader, drawSkybox, &skybox);
+
+        // bring the shadow cascades up to date, then go back to the scene target
+        shadowTimer.begin();
+        profiler.begin("Shadows");
+        shadows.render(depthShader, stream, programState->camera.GetViewMatrix(), projection, NEAR_PLANE,
+                       directionalLight.direction);
+        profiler.end();
+        shadowTimer.end();
+        programState->shadowMs = shadowTimer.milliseconds();
+        shadows.bind(SHADOW_MAP_TEXTURE_UNIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, deferred ? targets.gBufferFBO.id() : targets.hdrFBO.id());
+        glViewport(0, 0, sceneWidth, sceneHeight);
+        bindCameraBlock(stream, programState->camera.GetViewMatrix(), projection);
+
+        // sort and draw everything queued this frame
+        renderQueue.depthPrepass = programState->depthPrepassEnabled;
+        if (programState->depthPrepassEnabled) {
+            depthPrepassTimer.begin();
+            profiler.begin("Depth pre-pass");
+            depthShader.use();
+            renderQueue.executeDepthPrepass(depthShader);
+            profiler.end();
+            depthPrepassTimer.end();
+            programState->depthPrepassMs = depthPrepassTimer.milliseconds();
+        }
+        mainPassTimer.begin();
+        profiler.begin("Scene");
+        if (deferred) {
+            profiler.begin("G-buffer");
+            renderQueue.execute(RENDER_PASS_GBUFFER, RENDER_PASS_GBUFFER);
+            profiler.end();
+
+            // lighting pass, one light evaluation per visible pixel
+            profiler.begin("Lighting");
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.lightingFBO.id());
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDisable(GL_DEPTH_TEST);
+            deferredShader.use();
+            setLightUniforms(deferredShader);
+            programState->lightClusters.setUniforms(deferredShader, LIGHT_CLUSTER_TEXTURE_UNIT, sceneWidth, sceneHeight);
+            shadows.setUniforms(deferredShader, SHADOW_MAP_TEXTURE_UNIT);
+            deferredShader.setVec3("viewPosition", programState->camera.Position);
+            deferredShader.setMat4("inverseViewProjection", glm::inverse(projection * programState->camera.GetViewMatrix()));
+            deferredShader.setVec2("viewportSize", glm::vec2(sceneWidth, sceneHeight));
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, targets.gAlbedoSpec);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, targets.gNormalShininess);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, targets.depthBuffer);
             renderQuad();
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+            glActiveTexture(GL_TEXTURE0);
+            glEnable(GL_DEPTH_TEST);
+            profiler.end();
+
+            // unlit and transparent geometry and the skybox on top, depth comes from the g-buffer pass
+            profiler.begin("Forward");
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.hdrFBO.id());
+            renderQueue.execute(RENDER_PASS_OPAQUE, oit ? RENDER_PASS_SKYBOX : RENDER_PASS_TRANSPARENT);
+            profiler.end();
+        } else {
+            profiler.begin("Forward");
+            renderQueue.execute(RENDER_PASS_GBUFFER, oit ? RENDER_PASS_SKYBOX : RENDER_PASS_TRANSPARENT);
+            profiler.end();
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
+        // translucent geometry in any order into the oit targets, then composited over the scene in one pass
+        if (oit && renderQueue.size(RENDER_PASS_TRANSPARENT) > 0) {
+            profiler.begin("Transparency");
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.oitFBO.id());
+            const float accumulationClear[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+            const float weightClear[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            glClearBufferfv(GL_COLOR, 0, accumulationClear);
+            glClearBufferfv(GL_COLOR, 1, weightClear);
+            setWeightedBlended(ufoShader, saturnShader, true);
+            renderQueue.execute(RENDER_PASS_TRANSPARENT, RENDER_PASS_TRANSPARENT);
+            setWeightedBlended(ufoShader, saturnShader, false);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.hdrFBO.id());
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+            oitResolveShader.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, targets.oitAccumulation);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, targets.oitWeights);
+            renderQuad();
+            glActiveTexture(GL_TEXTURE0);
+            glDisable(GL_BLEND);
+            glEnable(GL_DEPTH_TEST);
+            profiler.end();
+        }
+        profiler.end();
+        mainPassTimer.end();
+        programState->mainPassMs = mainPassTimer.milliseconds();
+
+        // test this frame's bounding boxes against the finished depth, read back next frame
+        if (occlusion.enabled) {
+            profiler.begin("Occlusion queries");
+            depthShader.use();
+            occlusion.issueQueries(depthShader);
+            profiler.end();
+        }
+        // nothing after this reads the frame's stream data
+        stream.endFrame();
+
+        // average scene luminance for the composite's exposure, adapted on the gpu and never read back
+        AutoExposure& autoExposure = programState->autoExposure;
+        if (autoExposure.enabled) {
+            exposureTimer.begin();
+            profiler.begin("Auto exposure");
+            if (autoExposure.histogram && glExtensions().computeShaders)
+                autoExposure.reduceHistogram(histogramCompute, exposureCompute, targets.colorBuffer, sceneWidth,
+                                             sceneHeight, deltaTime);
+            else
+                autoExposure.reduceMipChain(luminanceShader, adaptShader, renderQuad, targets.colorBuffer, uvScale,
+                                            deltaTime);
+            profiler.end();
+            exposureTimer.end();
+            programState->exposureMs = exposureTimer.milliseconds();
+        }
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, autoExposure.adaptedLuminance());
+        ToneMapLut& toneMapLut = programState->toneMapLut;
+        toneMapLut.update();
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, toneMapLut.texture());
 
+        {
+            RG_PROFILE_SCOPE("Post-processing");
+            // bright pass: the resolved scene read once, thresholded into the first ping-pong buffer, then blurred,
+            // and the composite; as compute dispatches on GL 4.3, fullscreen passes otherwise
+            bool computePost = programState->computePost && glExtensions().computeShaders;
+            GpuTimer& postTimer = postTimers[computePost];
+            postTimer.begin();
+            profiler.begin("Post-processing");
+            const int blurPasses = 10;
+            bool horizontal = true;
+            glActiveTexture(GL_TEXTURE0);
+            if (computePost) {
+                const GLExtensions& extensions = glExtensions();
+                if (bloom) {
+                    profiler.begin("Bright pass");
+                    brightCompute.use();
+                    brightCompute.setVec2("uvScale", uvScale);
+                    brightCompute.setIVec2("outputSize", bloomSceneWidth, bloomSceneHeight);
+                    glBindTexture(GL_TEXTURE_2D, targets.colorBuffer);
+                    extensions.bindImageTexture(0, targets.pingpongColorbuffers[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, targets.colorFormat);
+                    ComputeShader::dispatch(ComputeShader::groups(bloomSceneWidth, 8), ComputeShader::groups(bloomSceneHeight, 8));
+                    profiler.end();
+
+                    // one workgroup per tile of a row or column, rows or columns along y
+                    profiler.begin("Blur");
+                    blurCompute.use();
+                    blurCompute.setIVec2("size", bloomSceneWidth, bloomSceneHeight);
+                    for (int i = 0; i < blurPasses; i++) {
+                        extensions.memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+                        blurCompute.setBool("horizontal", horizontal);
+                        glBindTexture(GL_TEXTURE_2D, targets.pingpongColorbuffers[!horizontal]);
+                        extensions.bindImageTexture(0, targets.pingpongColorbuffers[horizontal], 0, GL_FALSE, 0, GL_WRITE_ONLY, targets.colorFormat);
+                        int length = horizontal ? bloomSceneWidth : bloomSceneHeight;
+                        int lines = horizontal ? bloomSceneHeight : bloomSceneWidth;
+                        ComputeShader::dispatch(ComputeShader::groups(length, 128), (unsigned int) lines);
+                        horizontal = !horizontal;
+                    }
+                    extensions.memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+                    profiler.end();
+                }
+
+                // the window can't be bound as an image, the composite goes to an 8-bit target of the render
+                // targets' size that is blitted over, scaled to the window while a resize waits for the debounce
+                profiler.begin("Composite");
+                compositeCompute.use();
+                compositeCompute.setBool("bloom", bloom);
+                compositeCompute.setFloat("exposure", exposure);
+                compositeCompute.setBool("autoExposure", autoExposure.enabled);
+                compositeCompute.setVec2("uvScale", uvScale);
+                compositeCompute.setVec2("bloomUvScale", bloomUvScale);
+                compositeCompute.setIVec2("outputSize", targets.width, targets.height);
+                glBindTexture(GL_TEXTURE_2D, targets.colorBuffer);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, targets.pingpongColorbuffers[!horizontal]);
+                extensions.bindImageTexture(0, targets.ldrColorBuffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+                ComputeShader::dispatch(ComputeShader::groups(targets.width, 8), ComputeShader::groups(targets.height, 8));
+                extensions.memoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, targets.ldrFBO.id());
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                bool scaled = targets.width != framebufferWidth || targets.height != framebufferHeight;
+                glBlitFramebuffer(0, 0, targets.width, targets.height, 0, 0, framebufferWidth, framebufferHeight,
+                                  GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, framebufferWidth, framebufferHeight);
+                profiler.end();
+            } else {
+                if (bloom) {
+                    profiler.begin("Bright pass");
+                    glViewport(0, 0, bloomSceneWidth, bloomSceneHeight);
+                    glDisable(GL_DEPTH_TEST);
+                    glBindFramebuffer(GL_FRAMEBUFFER, targets.pingpongFBO[0].id());
+                    brightShader.use();
+                    brightShader.setVec2("uvScale", uvScale);
+                    glBindTexture(GL_TEXTURE_2D, targets.colorBuffer);
+                    renderQuad();
+                    profiler.end();
+
+                    profiler.begin("Blur");
+                    blurShader.use();
+                    blurShader.setVec2("uvScale", bloomUvScale);
+                    for (int i = 0; i < blurPasses; i++) {
+                        glBindFramebuffer(GL_FRAMEBUFFER, targets.pingpongFBO[horizontal].id());
+                        blurShader.setInt("horizontal", horizontal);
+                        glBindTexture(GL_TEXTURE_2D, targets.pingpongColorbuffers[!horizontal]);
+                        renderQuad();
+                        horizontal = !horizontal;
+                    }
+                    glEnable(GL_DEPTH_TEST);
+                    profiler.end();
+                }
+                profiler.begin("Composite");
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                // the window may already have its new size while the targets wait for the debounce
+                glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                bloomShader.use();
+                glBindTexture(GL_TEXTURE_2D, targets.colorBuffer);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, targets.pingpongColorbuffers[!horizontal]);
+                bloomShader.setBool("bloom", bloom);
+                bloomShader.setFloat("exposure", exposure);
+                bloomShader.setBool("autoExposure", autoExposure.enabled);
+                bloomShader.setVec2("uvScale", uvScale);
+                bloomShader.setVec2("bloomUvScale", bloomUvScale);
+                renderQuad();
+                profiler.end();
+            }
+            glActiveTexture(GL_TEXTURE0);
+            profiler.end();
+            postTimer.end();
+            programState->postMs[computePost] = postTimer.milliseconds();
+        }
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        bloomShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        bloomShader.setBool("bloom", bloom);
-        bloomShader.setFloat("exposure", exposure);
-        renderQuad();
+        gpuFrameTimer.end();
 
-        if (programState->ImGuiEnabled)
+        if (programState->ImGuiEnabled || programState->performanceHud) {
+            profiler.begin("ImGui");
             DrawImGui();
-
-
+            profiler.end();
+        }
+        float cpuMs = (float) ((glfwGetTime() - workStart) * 1000.0);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            RG_PROFILE_SCOPE("Swap");
+            glfwSwapBuffers(window);
+        }
+        pacer.endFrame();
         glfwPollEvents();
+        renderTargetPool.endFrame();
+        GLDeletionQueue::shared().endFrame();
+        // over the gpu memory budget, give up the idle render targets kept for reuse first
+        GpuMemory& gpuMemory = GpuMemory::shared();
+        if (gpuMemory.overBudget())
+            programState->evictedBytes += renderTargetPool.evictIdle();
+        gpuMemory.checkBudget();
+
+        programState->frameStats.record(deltaTime * 1000.0f, cpuMs, gpuFrameTimer.milliseconds());
+        unsigned int allocations = renderTargetPool.createdTextures + stream.orphanCount + stream.growCount;
+        programState->frameAllocations = allocations - countedAllocations;
+        countedAllocations = allocations;
     }
 
+    writeCpuTrace();
+    GpuMemory::shared().printSummary(std::cout);
+    // free everything before the context goes, whatever is left after that leaked
+    scene.reset();
+    Mesh::ReleaseTextureSets();
+    skybox = Skybox();
+    quadVAO.reset();
+    quadVBO.reset();
+    resources.reset();
     delete programState;
+    GeometryPool::shared().release();
+    GLDeletionQueue& deletionQueue = GLDeletionQueue::shared();
+    deletionQueue.flush();
+    deletionQueue.reportLeaks(std::cout);
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -486,6 +1011,7 @@ int main() {
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window) {
+    RG_PROFILE_FUNCTION();
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
@@ -516,9 +1042,11 @@ void processInput(GLFWwindow *window) {
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // only record the new size; note that width and height will be significantly larger
+    // than specified on retina displays. Render targets are reallocated in the render loop.
+    framebufferWidth = width;
+    framebufferHeight = height;
+    lastResizeTime = glfwGetTime();
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -547,10 +1075,59 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
 }
 
 void DrawImGui() {
+    RG_PROFILE_FUNCTION();
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
+    if (programState->performanceHud)
+        DrawPerformanceHud();
+    if (programState->ImGuiEnabled)
+        DrawSettings();
+
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
+
+// frame times and the renderer's counters of the last frame
+void DrawPerformanceHud() {
+    const FrameStats& stats = programState->frameStats;
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    ImGui::Begin("Performance", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing);
+    FrameStats::Percentiles frame = stats.framePercentiles();
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "p50 %.2f  p95 %.2f  p99 %.2f ms", frame.p50, frame.p95, frame.p99);
+    // the scale keeps room above the slowest frames
+    ImGui::PlotLines("##frame times", stats.frameTimes(), stats.count(), stats.offset(), overlay, 0.0f,
+                     std::max(frame.p99 * 1.5f, 1.0f), ImVec2(320.0f, 80.0f));
+    FrameStats::Percentiles cpu = stats.cpuPercentiles();
+    FrameStats::Percentiles gpu = stats.gpuPercentiles();
+    ImGui::Text("CPU %6.2f ms (p95 %6.2f, p99 %6.2f)", stats.latestCpuMs(), cpu.p95, cpu.p99);
+    ImGui::Text("GPU %6.2f ms (p95 %6.2f, p99 %6.2f)", stats.latestGpuMs(), gpu.p95, gpu.p99);
+    const RenderQueue& queue = programState->renderQueue;
+    ImGui::Text("Draw calls: %u, meshes: %u, triangles: %u", queue.drawCalls, queue.meshesDrawn, queue.trianglesDrawn);
+    ImGui::Text("Switches: program %u, texture %u, VAO %u", queue.programSwitches, queue.textureSwitches,
+                queue.vertexArraySwitches);
+    const RenderTargetPool* pool = programState->renderTargetPool;
+    const StreamBuffer& stream = programState->stream;
+    if (pool)
+        ImGui::Text("Render targets: %.1f MB in %zu textures", pool->allocatedBytes / (1024.0f * 1024.0f),
+                    pool->allocatedCount());
+    ImGui::Text("Stream buffer: %.1f MB, %.1f KB written", stream.bufferSize() / (1024.0f * 1024.0f),
+                stream.bytesWritten / 1024.0f);
+    ImGui::Text("GPU allocations this frame: %u", programState->frameAllocations);
+    const GpuMemory& memory = GpuMemory::shared();
+    if (memory.budgetBytes > 0)
+        ImGui::TextColored(memory.overBudget() ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f) : ImVec4(1.0f, 1.0f, 1.0f, 1.0f),
+                           "GPU memory: %.1f of %.1f MB", memory.totalBytes() / (1024.0f * 1024.0f),
+                           memory.budgetBytes / (1024.0f * 1024.0f));
+    else
+        ImGui::Text("GPU memory: %.1f MB", memory.totalBytes() / (1024.0f * 1024.0f));
+    ImGui::End();
+}
+
+void DrawSettings() {
     ImGui::Begin("Camera info");
     const Camera& c = programState->camera;
     ImGui::Text("Camera position: (%f, %f, %f)", c.Position.x, c.Position.y, c.Position.z);
@@ -559,8 +1136,153 @@ void DrawImGui() {
     ImGui::Checkbox("Camera mouse update", &programState->CameraMouseMovementUpdateEnabled);
     ImGui::End();
 
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    ImGui::Begin("Rendering");
+    ResolutionScaler& scaler = programState->resolutionScaler;
+    if (ImGui::Checkbox("Dynamic resolution", &programState->dynamicResolutionEnabled))
+        scaler.reset();
+    ImGui::DragFloat("Frame budget (ms)", &scaler.targetFrameMs, 0.1f, 1.0f, 100.0f);
+    ImGui::SliderFloat("Min scale", &scaler.minScale, 0.25f, scaler.maxScale);
+    ImGui::SliderFloat("Max scale", &scaler.maxScale, scaler.minScale, 1.0f);
+    ImGui::Text("Scale: %.2f, gpu frame: %.2f ms", scaler.scale(), scaler.smoothedFrameMs());
+    FramePacer& pacer = programState->pacer;
+    ImGui::SliderInt("Frames in flight", &pacer.framesInFlight, 1, (int) FramePacer::MAX_FRAMES_IN_FLIGHT);
+    ImGui::SliderInt("Swap interval", &pacer.swapInterval, 0, 2);
+    ImGui::DragFloat("Frame rate cap (0 = off)", &pacer.targetFps, 1.0f, 0.0f, 500.0f);
+    ImGui::Text("Cpu waited on gpu: %.3f ms, limiter: %.3f ms, gpu idle: %.3f ms", pacer.cpuWaitMs,
+                pacer.limiterMs, pacer.gpuWaitMs);
+    ViewCuller& culler = programState->culler;
+    ImGui::Checkbox("Frustum culling", &culler.enabled);
+    ImGui::DragFloat("Min pixel size", &culler.minPixelSize, 0.1f, 0.0f, 32.0f);
+    ImGui::Text("Meshes drawn: %u, culled: %u", culler.visibleMeshes, culler.culledMeshes);
+    OcclusionCuller& occlusion = programState->occlusion;
+    ImGui::Checkbox("Occlusion queries", &occlusion.enabled);
+    ImGui::Text("Occlusion queries: %u, culled draws: %u, conditional draws: %u", occlusion.queriesIssued,
+                occlusion.culledDraws, occlusion.conditionalDraws);
+    ImGui::Checkbox("CPU occlusion culling", &programState->softwareOcclusionEnabled);
+    if (programState->softwareOcclusionEnabled) {
+        const SoftwareOcclusion& softwareOcclusion = programState->softwareOcclusion;
+        ImGui::Text("Occluder triangles: %u (%u rasterized), %.3f ms %s, meshes occluded: %u",
+                    softwareOcclusion.occluderTriangles, softwareOcclusion.rasterizedTriangles,
+                    softwareOcclusion.rasterMs, rg::simd::NAME, culler.occludedMeshes);
+    }
+    RenderQueue& queue = programState->renderQueue;
+    const GLExtensions& extensions = glExtensions();
+    if (extensions.multiDrawIndirect)
+        ImGui::Checkbox("Multi-draw indirect", &queue.multiDraw);
+    else
+        ImGui::Text("Multi-draw indirect: not supported by GL %d.%d", extensions.majorVersion, extensions.minorVersion);
+    ImGui::Text("Draw calls: %u for %u meshes, program switches: %u", queue.drawCalls, queue.meshesDrawn,
+                queue.programSwitches);
+    ImGui::Text("Texture switches: %u, VAO switches: %u", queue.textureSwitches, queue.vertexArraySwitches);
+    const StreamBuffer& stream = programState->stream;
+    ImGui::Text("Stream buffer (%s): %.1f of %.1f KB per frame, waited %.3f ms, orphaned %u, grown %u",
+                stream.persistent() ? "persistent" : "unsynchronized maps", stream.bytesWritten / 1024.0f,
+                stream.regionSize() / 1024.0f, stream.waitMs, stream.orphanCount, stream.growCount);
+    int formatIndex = 0;
+    const char* formatNames[HDR_FORMAT_COUNT];
+    for (unsigned int i = 0; i < HDR_FORMAT_COUNT; i++) {
+        formatNames[i] = HDR_FORMATS[i].name;
+        if (HDR_FORMATS[i].internalFormat == programState->hdrFormat)
+            formatIndex = i;
+    }
+    if (ImGui::Combo("HDR target format", &formatIndex, formatNames, HDR_FORMAT_COUNT))
+        programState->hdrFormat = HDR_FORMATS[formatIndex].internalFormat;
+    const HdrFormat& activeFormat = hdrFormat(programState->activeHdrFormat);
+    ImGui::Checkbox("Half resolution bloom", &programState->halfResolutionBloom);
+    if (extensions.computeShaders)
+        ImGui::Checkbox("Compute post-processing", &programState->computePost);
+    else
+        ImGui::Text("Compute post-processing: not supported by GL %d.%d", extensions.majorVersion, extensions.minorVersion);
+    ImGui::Text("Post-processing: fragment %.3f ms, compute %.3f ms", programState->postMs[0], programState->postMs[1]);
+    AutoExposure& autoExposure = programState->autoExposure;
+    if (ImGui::Checkbox("Auto exposure", &autoExposure.enabled) && autoExposure.enabled)
+        autoExposure.reset();
+    if (autoExposure.enabled) {
+        if (extensions.computeShaders)
+            ImGui::Checkbox("Luminance histogram", &autoExposure.histogram);
+        ImGui::DragFloatRange2("Log2 luminance range", &autoExposure.minLogLuminance, &autoExposure.maxLogLuminance,
+                               0.1f, -16.0f, 16.0f);
+        ImGui::SliderFloat("Darkest adapted luminance", &autoExposure.minAdaptedLuminance, 1.0f / 1024.0f, 1.0f, "%.4f",
+                           ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Adaptation up", &autoExposure.speedUp, 0.1f, 10.0f);
+        ImGui::SliderFloat("Adaptation down", &autoExposure.speedDown, 0.1f, 10.0f);
+        ImGui::Text("Exposure reduction (%s): %.3f ms",
+                    autoExposure.histogram && extensions.computeShaders ? "histogram" : "mip chain",
+                    programState->exposureMs);
+    }
+    ToneMapLut& toneMapLut = programState->toneMapLut;
+    ImGui::ColorEdit3("Color filter", &toneMapLut.grading.colorFilter[0]);
+    ImGui::SliderFloat("Saturation", &toneMapLut.grading.saturation, 0.0f, 2.0f);
+    ImGui::SliderFloat("Contrast", &toneMapLut.grading.contrast, 0.5f, 2.0f);
+    ImGui::Text("Tone map LUT %d^3: baked %u times, last %.2f ms", ToneMapLut::SIZE, toneMapLut.bakeCount,
+                toneMapLut.bakeMs);
+    // the scene color and two ping-pong buffers, a quarter of the pixels each at half resolution
+    float fullSizeTargets = 1.0f + (programState->halfResolutionBloom ? 0.5f : 2.0f);
+    ImGui::Text("HDR targets: %s, %.1f MB, worst banding step %.2f of %.1f", activeFormat.name,
+                fullSizeTargets * framebufferWidth * framebufferHeight * activeFormat.bytesPerPixel / (1024.0f * 1024.0f),
+                programState->hdrBandingStep, BANDING_LIMIT);
+    ImGui::Checkbox("Deferred shading", &programState->deferredShading);
+    ImGui::Checkbox("Order independent transparency", &queue.orderIndependentTransparency);
+    ImGui::SliderInt("Swarm lights", &programState->lightSwarmCount, 0, 2048);
+    const LightClusters& clusters = programState->lightClusters;
+    ImGui::Text("Lights: %u, cluster entries: %u, busiest cluster: %u", clusters.lightCount,
+                clusters.assignedLights, clusters.busiestCluster);
+    ImGui::Text("Dropped: %u, binning: %.3f ms on %u threads", clusters.droppedLights, clusters.binningMs,
+                programState->workers.threadCount());
+    ShadowCascades& shadows = programState->shadows;
+    ImGui::Checkbox("Shadows", &shadows.enabled);
+    ImGui::DragFloat("Shadow distance", &shadows.shadowDistance, 0.5f, 5.0f, 100.0f);
+    ImGui::SliderFloat("Cascade split lambda", &shadows.splitLambda, 0.0f, 1.0f);
+    ImGui::Text("Shadow casters drawn: %u, culled: %u, static cascades redrawn: %u (%u total)",
+                shadows.castersDrawn, shadows.castersCulled, shadows.staticCascadesRendered, shadows.staticRenderTotal);
+    ImGui::Text("Shadows: %.3f ms", programState->shadowMs);
+    ImGui::Checkbox("Depth pre-pass", &programState->depthPrepassEnabled);
+    if (programState->depthPrepassEnabled)
+        ImGui::Text("Pre-pass: %.3f ms, main pass: %.3f ms, total: %.3f ms", programState->depthPrepassMs,
+                    programState->mainPassMs, programState->depthPrepassMs + programState->mainPassMs);
+    else
+        ImGui::Text("Main pass: %.3f ms", programState->mainPassMs);
+    ImGui::End();
+
+    ImGui::Begin("GPU profiler");
+    GpuProfiler& profiler = programState->gpuProfiler;
+    ImGui::Checkbox("Enabled", &profiler.enabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Export CSV")) {
+        const char* path = "gpu_profile.csv";
+        programState->gpuProfileStatus = profiler.exportCsv(path) ? std::string("Saved ") + path
+                                                                  : std::string("Could not write ") + path;
+    }
+    if (!programState->gpuProfileStatus.empty())
+        ImGui::Text("%s", programState->gpuProfileStatus.c_str());
+    ImGui::Text("Dropped frames: %u", profiler.droppedFrames);
+    for (const GpuProfiler::ScopeResult& scope : profiler.results())
+        ImGui::Text("%*s%-*s %7.3f ms (avg %7.3f)", 2 * scope.depth, "", 24 - 2 * scope.depth, scope.name.c_str(),
+                    scope.lastMs, scope.averageMs);
+    ImGui::End();
+
+    ImGui::Begin("GPU memory");
+    GpuMemory& memory = GpuMemory::shared();
+    int budgetMb = (int) (memory.budgetBytes / (1024 * 1024));
+    if (ImGui::DragInt("Budget (MB, 0 = off)", &budgetMb, 8.0f, 0, 65536))
+        memory.budgetBytes = (size_t) std::max(budgetMb, 0) * 1024 * 1024;
+    ImGui::Text("Total: %.1f MB in %zu objects, peak %.1f MB", memory.totalBytes() / (1024.0f * 1024.0f),
+                memory.objectCount(), memory.peakBytes() / (1024.0f * 1024.0f));
+    ImGui::Text("Budget exceeded: %u times, render targets evicted: %.1f MB", memory.budgetExceeded,
+                programState->evictedBytes / (1024.0f * 1024.0f));
+    const GLDeletionQueue& deletionQueue = GLDeletionQueue::shared();
+    ImGui::Text("GL handles: %u alive, %zu awaiting deletion, %u deleted", deletionQueue.liveCount(),
+                deletionQueue.pendingCount(), deletionQueue.deletedObjects);
+    if (ImGui::Button("Reload scene (F5)"))
+        programState->reloadScene = true;
+    for (int c = 0; c < GPU_MEMORY_CATEGORY_COUNT; c++)
+        ImGui::Text("%-16s %8.2f MB", GPU_MEMORY_CATEGORY_NAMES[c],
+                    memory.categoryBytes((GpuMemoryCategory) c) / (1024.0f * 1024.0f));
+    ImGui::Separator();
+    for (const GpuMemory::OwnerUsage& usage : memory.owners())
+        ImGui::Text("%-32s %8.2f MB in %u (%s)", usage.owner.c_str(), usage.bytes / (1024.0f * 1024.0f), usage.objects,
+                    GPU_MEMORY_CATEGORY_NAMES[usage.category]);
+    ImGui::End();
 }
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
@@ -574,6 +1296,15 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
         }
     }
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS) {
+        writeCpuTrace();
+    }
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+        programState->performanceHud = !programState->performanceHud;
+    }
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS) {
+        programState->reloadScene = true;
+    }
     if (key == GLFW_KEY_H && action == GLFW_PRESS) {
         hdr = !hdr;
     }
@@ -584,11 +1315,13 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 
 unsigned int loadCubemap(vector<std::string> &faces)
 {
+    RG_PROFILE_FUNCTION();
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
+    size_t bytes = 0;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
         unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
@@ -597,6 +1330,7 @@ unsigned int loadCubemap(vector<std::string> &faces)
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
                          0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data
             );
+            bytes += GpuMemory::textureBytes(GL_RGBA, width, height);
             stbi_image_free(data);
         }
         else
@@ -610,15 +1344,88 @@ unsigned int loadCubemap(vector<std::string> &faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    GpuMemory::shared().track(GPU_OBJECT_TEXTURE, textureID, bytes, GPU_MEMORY_TEXTURES, "Skybox");
 
     return textureID;
 }
 
-unsigned int quadVAO = 0;
-unsigned int quadVBO;
+// the cpu profiler's events so far as a chrome trace, on F2 and at exit; called between frames, while
+// the workers are idle
+void writeCpuTrace()
+{
+    const char* path = "cpu_trace.json";
+    if (RG_PROFILE_WRITE_TRACE(path))
+        std::cout << "CPU trace written to " << path << std::endl;
+}
+
+// the shaders translucent meshes are drawn with switch their outputs for the oit pass
+void setWeightedBlended(Shader &ufoShader, Shader &litShader, bool enabled)
+{
+    ufoShader.use();
+    ufoShader.setBool("weightedBlended", enabled);
+    litShader.use();
+    litShader.setBool("weightedBlended", enabled);
+}
+
+// lights shared by the forward lit shader and the deferred lighting pass
+void setLightUniforms(Shader &shader)
+{
+    RG_PROFILE_FUNCTION();
+    const DirectionalLight& directionalLight = programState->directionalLight;
+    shader.setVec3("directionalLight.direction", directionalLight.direction);
+    shader.setVec3("directionalLight.ambient", directionalLight.ambient);
+    shader.setVec3("directionalLight.diffuse", directionalLight.diffuse);
+    shader.setVec3("directionalLight.specular", directionalLight.specular);
+
+    const SpotLight& ufoSpotLight = programState->ufoSpotLight;
+    shader.setVec3("ufoLight.ambient", ufoSpotLight.ambient);
+    shader.setVec3("ufoLight.diffuse", ufoSpotLight.diffuse);
+    shader.setVec3("ufoLight.specular", ufoSpotLight.specular);
+    shader.setVec3("ufoLight.position", ufoSpotLight.position);
+    shader.setVec3("ufoLight.direction", ufoSpotLight.direction);
+    shader.setFloat("ufoLight.cutOff", ufoSpotLight.cutoff);
+    shader.setFloat("ufoLight.outerCutOff", ufoSpotLight.outerCutOff);
+    shader.setFloat("ufoLight.constant", ufoSpotLight.constant);
+    shader.setFloat("ufoLight.linear", ufoSpotLight.linear);
+    shader.setFloat("ufoLight.quadratic", ufoSpotLight.quadratic);
+}
+
+// small colored lights orbiting saturn, derived from the index and time so nothing has to be stored
+void addLightSwarm(std::vector<PointLight> &lights, int count, float time)
+{
+    for (int i = 0; i < count; i++) {
+        float golden = i * 0.618034f - std::floor(i * 0.618034f);
+        float plastic = i * 0.754878f - std::floor(i * 0.754878f);
+        float phase = i * 2.39996f;
+        float orbit = 4.5f + 4.0f * golden;
+        float angle = phase + time * (0.1f + 0.3f * plastic);
+
+        PointLight light;
+        light.position = programState->saturnPosition
+                         + glm::vec3(cos(angle) * orbit, 1.5f * sin(phase * 3.0f + time * 0.5f), sin(angle) * orbit);
+        glm::vec3 color = 0.5f + 0.5f * glm::cos(6.28318f * (plastic + glm::vec3(0.0f, 0.33f, 0.67f)));
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = color * 0.8f;
+        light.specular = color * 0.3f;
+        light.constant = 1.0f;
+        light.linear = 0.7f;
+        light.quadratic = 8.0f;
+        lights.push_back(light);
+    }
+}
+
+void drawSkybox(void *userData)
+{
+    Skybox *skybox = (Skybox *) userData;
+    glBindVertexArray(skybox->VAO.id());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->cubemapTexture.id());
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+}
+
 void renderQuad()
 {
-    if (quadVAO == 0)
+    if (!quadVAO)
     {
         float quadVertices[] = {
                 // positions        // texture Coords
@@ -628,17 +1435,92 @@ void renderQuad()
                 1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
         };
         // setup plane VAO
-        glGenVertexArrays(1, &quadVAO);
-        glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        quadVAO = GLVertexArray::create();
+        quadVBO = GLBuffer::create();
+        glBindVertexArray(quadVAO.id());
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO.id());
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        GpuMemory::shared().track(GPU_OBJECT_BUFFER, quadVBO.id(), sizeof(quadVertices), GPU_MEMORY_GEOMETRY, "renderQuad");
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    glBindVertexArray(quadVAO.id());
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glBindVertexArray(0);
-}
\ No newline at end of file
+}
+
+// (re)attach pooled textures of the given size to the hdr and ping-pong framebuffers.
+// The previous textures go back to the pool and get deleted once they stay unused for a few frames.
+void resizeRenderTargets(RenderTargets &targets, RenderTargetPool &pool, int width, int height)
+{
+    pool.release(targets.colorBuffer);
+    for (unsigned int i = 0; i < 2; i++)
+        pool.release(targets.pingpongColorbuffers[i]);
+    pool.release(targets.depthBuffer);
+    pool.release(targets.gAlbedoSpec);
+    pool.release(targets.gNormalShininess);
+    pool.release(targets.oitAccumulation);
+    pool.release(targets.oitWeights);
+    pool.release(targets.ldrColorBuffer);
+
+    targets.width = width;
+    targets.height = height;
+    targets.bloomWidth = std::max(1, width / targets.bloomDivisor);
+    targets.bloomHeight = std::max(1, height / targets.bloomDivisor);
+
+    // the scene writes a single color target, the bright parts are extracted after it
+    glBindFramebuffer(GL_FRAMEBUFFER, targets.hdrFBO.id());
+    targets.colorBuffer = pool.acquire(width, height, targets.colorFormat);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.colorBuffer, 0);
+    targets.depthBuffer = pool.acquire(width, height, GL_DEPTH24_STENCIL8);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, targets.depthBuffer, 0);
+    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(1, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout<<"SOMETHING AIN'T RIGHT!\n";
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targets.lightingFBO.id());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.colorBuffer, 0);
+    glDrawBuffers(1, attachments);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targets.gBufferFBO.id());
+    targets.gAlbedoSpec = pool.acquire(width, height, GL_RGBA8);
+    targets.gNormalShininess = pool.acquire(width, height, GL_RGB10_A2);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.gAlbedoSpec, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, targets.gNormalShininess, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, targets.depthBuffer, 0);
+    glDrawBuffers(2, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "G-buffer not complete!" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targets.oitFBO.id());
+    targets.oitAccumulation = pool.acquire(width, height, GL_RGBA16F);
+    targets.oitWeights = pool.acquire(width, height, GL_R16F);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.oitAccumulation, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, targets.oitWeights, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, targets.depthBuffer, 0);
+    glDrawBuffers(2, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "OIT framebuffer not complete!" << std::endl;
+
+    //blurring
+    for (unsigned int i = 0; i < 2; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, targets.pingpongFBO[i].id());
+        targets.pingpongColorbuffers[i] = pool.acquire(targets.bloomWidth, targets.bloomHeight, targets.colorFormat);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.pingpongColorbuffers[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer not complete!" << std::endl;
+    }
+
+    // the composite is written as an image and read by the blit only, it never needs draw buffers
+    targets.ldrColorBuffer = 0;
+    if (glExtensions().computeShaders) {
+        glBindFramebuffer(GL_FRAMEBUFFER, targets.ldrFBO.id());
+        targets.ldrColorBuffer = pool.acquire(width, height, GL_RGBA8);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.ldrColorBuffer, 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}